@@ -0,0 +1,133 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <QtGui/QImage>
+
+#include "MeshShader.h"
+
+#ifdef _WIN32
+#define GL_CLAMP_TO_EDGE 0x812F
+#define GL_BGRA 0x80E1
+#endif
+
+static Vector HSV2RGB(Vector hsv) {
+  // As in Wikipedia
+  double c = hsv[2] * hsv[1];
+  double h = hsv[0] / 60;
+  double x = c * (1 - std::abs(std::fmod(h, 2) - 1));
+  double m = hsv[2] - c;
+  Vector rgb(m, m, m);
+  if (h <= 1)
+    return rgb + Vector(c, x, 0);
+  if (h <= 2)
+    return rgb + Vector(x, c, 0);
+  if (h <= 3)
+    return rgb + Vector(0, c, x);
+  if (h <= 4)
+    return rgb + Vector(0, x, c);
+  if (h <= 5)
+    return rgb + Vector(x, 0, c);
+  if (h <= 6)
+    return rgb + Vector(c, 0, x);
+  return rgb;
+}
+
+Vector MeshShader::meanMapColor(double t) {
+  double red = 0, green = 120, blue = 240; // Hue
+  if (t < 0)
+    return HSV2RGB({green * (1 + t) - blue * t, 1, 1});
+  return HSV2RGB({green * (1 - t) + red * t, 1, 1});
+}
+
+MeshShader::MeshShader() :
+  isophote_texture(0), environment_texture(0), slicing_texture(0), mean_texture(0)
+{
+}
+
+bool MeshShader::init() {
+  initializeOpenGLFunctions();
+
+  QImage img(":/isophotes.png");
+  glGenTextures(1, &isophote_texture);
+  glBindTexture(GL_TEXTURE_2D, isophote_texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, img.width(), img.height(), 0, GL_BGRA,
+               GL_UNSIGNED_BYTE, img.convertToFormat(QImage::Format_ARGB32).bits());
+
+  QImage img2(":/environment.png");
+  glGenTextures(1, &environment_texture);
+  glBindTexture(GL_TEXTURE_2D, environment_texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, img2.width(), img2.height(), 0, GL_BGRA,
+               GL_UNSIGNED_BYTE, img2.convertToFormat(QImage::Format_ARGB32).bits());
+
+  glGenTextures(1, &slicing_texture);
+  glBindTexture(GL_TEXTURE_1D, slicing_texture);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  static const unsigned char slicing_img[] = { 0b11111111, 0b00011100 };
+  glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB, 2, 0, GL_RGB, GL_UNSIGNED_BYTE_3_3_2, &slicing_img);
+
+  // Color map of the mean curvature, sampled in [-1, 1]
+  std::vector<GLfloat> mean_img;
+  for (int i = 0; i < 256; ++i) {
+    auto color = meanMapColor(i / 127.5 - 1.0);
+    mean_img.insert(mean_img.end(), { (GLfloat)color[0], (GLfloat)color[1], (GLfloat)color[2] });
+  }
+  glGenTextures(1, &mean_texture);
+  glBindTexture(GL_TEXTURE_1D, mean_texture);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB8, 256, 0, GL_RGB, GL_FLOAT, mean_img.data());
+
+  shader.bindAttributeLocation("curvature", CURVATURE_ATTRIBUTE);
+  if (!shader.addShaderFromSourceFile(QOpenGLShader::Vertex, ":/mesh.vert") ||
+      !shader.addShaderFromSourceFile(QOpenGLShader::Fragment, ":/mesh.frag") ||
+      !shader.link()) {
+    std::cerr << "Shader error: " << shader.log().toStdString() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void MeshShader::destroy() {
+  if (!isophote_texture)
+    return;                     // not initialized
+  glDeleteTextures(1, &isophote_texture);
+  glDeleteTextures(1, &environment_texture);
+  glDeleteTextures(1, &slicing_texture);
+  glDeleteTextures(1, &mean_texture);
+  shader.removeAllShaders();
+  isophote_texture = environment_texture = slicing_texture = mean_texture = 0;
+}
+
+void MeshShader::bind(Mode mode, bool environment, double mean_min, double mean_max,
+                      const Vector &slicing) {
+  // Changing the visualization only changes uniforms and texture bindings
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_1D, mode == Mode::SLICING ? slicing_texture : mean_texture);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, environment ? environment_texture : isophote_texture);
+  glActiveTexture(GL_TEXTURE0);
+  shader.bind();
+  shader.setUniformValue("mode", static_cast<int>(mode));
+  shader.setUniformValue("mean_min", static_cast<GLfloat>(mean_min));
+  shader.setUniformValue("mean_max", static_cast<GLfloat>(mean_max));
+  shader.setUniformValue("slicing", static_cast<GLfloat>(slicing[0]),
+                         static_cast<GLfloat>(slicing[1]), static_cast<GLfloat>(slicing[2]));
+  shader.setUniformValue("map1d", 0);
+  shader.setUniformValue("map2d", 1);
+}
+
+void MeshShader::release() {
+  shader.release();
+}
@@ -0,0 +1,36 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <QtGui/QOpenGLFunctions_2_1>
+#include <QtGui/QOpenGLShaderProgram>
+
+#include "mesh.hh"
+
+// The shader of the mesh visualizations (mesh.vert, mesh.frag) with its textures,
+// shared by the viewer and the offscreen renderer.
+// Positions and normals come from the fixed-function arrays, the displayed curvature field
+// from the CURVATURE_ATTRIBUTE vertex attribute.
+class MeshShader : protected QOpenGLFunctions_2_1 {
+public:
+  enum class Mode { PLAIN, MEAN, SLICING, ISOPHOTES }; // as in mesh.frag
+  static constexpr GLuint CURVATURE_ATTRIBUTE = 1;
+
+  MeshShader();
+
+  // Both in the OpenGL context to be used
+  bool init();
+  void destroy();
+
+  // The sphere map of the ISOPHOTES mode is the environment map when `environment` is set;
+  // `slicing` is the slicing direction scaled by the density of the stripes.
+  void bind(Mode mode, bool environment, double mean_min, double mean_max,
+            const Vector &slicing);
+  void release();
+
+  // Color of t in [-1, 1] (scaled by the range of the field) on the color map of MEAN
+  static Vector meanMapColor(double t);
+
+private:
+  GLuint isophote_texture, environment_texture, slicing_texture, mean_texture;
+  QOpenGLShaderProgram shader;
+};
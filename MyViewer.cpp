@@ -2,302 +2,106 @@
 #include <cmath>
 #include <fstream>
 #include <iostream>
-#include <map>
 #include <vector>
 
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QStandardPaths>
 #include <QtGui/QKeyEvent>
 
 #include <OpenMesh/Core/IO/MeshIO.hh>
 #include <OpenMesh/Tools/Smoother/JacobiLaplaceSmootherT.hh>
 
-// #define BETTER_MEAN_CURVATURE
-
-#ifdef BETTER_MEAN_CURVATURE
-#include "Eigen/Eigenvalues"
-#include "Eigen/Geometry"
-#include "Eigen/LU"
-#include "Eigen/SVD"
-#endif
-
 #include "MyViewer.h"
+#include "mesh-export.hh"
+#include "mesh-loader.hh"
+#include "patch-file.hh"
+#include "tessellation.hh"
+#include "trace.hh"
 #include "trigo-basis.hh"
 
-#ifdef _WIN32
-#define GL_CLAMP_TO_EDGE 0x812F
-#define GL_BGRA 0x80E1
-#endif
-
 MyViewer::MyViewer(QWidget *parent) :
   QGLViewer(parent), model_type(ModelType::NONE),
-  trigonometric_basis(false),
-  mean_min(0.0), mean_max(0.0), cutoff_ratio(0.05),
-  show_control_points(true), show_solid(true), show_wireframe(false),
-  visualization(Visualization::PLAIN), slicing_dir(0, 0, 1), slicing_scaling(1),
-  last_filename("")
+  curvature_estimator(CurvatureEstimator::DIHEDRAL),
+  mean_min(0.0), mean_max(0.0), cutoff_ratio(0.05), displayed_field(CurvatureFields::MEAN),
+  show_control_points(true), show_solid(true), show_wireframe(false), show_contours(false),
+  visualization(Visualization::PLAIN), environment_map(false),
+  slicing_dir(0, 0, 1), slicing_scaling(1),
+  last_filename(""), watching(false), computation_cancelled(false)
 {
   setSelectRegionWidth(10);
   setSelectRegionHeight(10);
-  axes.shown = false;
+  axes.shown = axes.dragging = false;
+  buffers.vertices = buffers.attributes = buffers.indices = 0;
+  buffers.n_indices = 0;
+  buffers.geometry_dirty = buffers.topology_dirty = buffers.attributes_dirty = true;
+  picking_dirty = intersector_dirty = contours_dirty = cloud_dirty = true;
+  incremental_dirty = true;
   trigoinit("trigo.tab");
-}
 
-MyViewer::~MyViewer() {
-  glDeleteTextures(1, &isophote_texture);
-  glDeleteTextures(1, &environment_texture);
-  glDeleteTextures(1, &slicing_texture);
+  // Editors often save in several writes (or by replacing the file), so a reload waits until
+  // the file has not changed for a while
+  reload_timer.setSingleShot(true);
+  reload_timer.setInterval(100);
+  connect(&watcher, SIGNAL(fileChanged(QString)), this, SLOT(watchedFileChanged()));
+  connect(&watcher, SIGNAL(directoryChanged(QString)), this, SLOT(watchedDirectoryChanged()));
+  connect(&reload_timer, SIGNAL(timeout()), this, SLOT(reloadWatchedFile()));
+
+  auto cache_dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+    "/tessellations";
+  if (QDir().mkpath(cache_dir))
+    tessellation_cache.open(cache_dir.toStdString());
 }
 
-void MyViewer::updateMeanMinMax() {
-  size_t n = mesh.n_vertices();
-  if (n == 0)
-    return;
-
-  std::vector<double> mean;
-  mean.reserve(n);
-  for (auto v : mesh.vertices())
-    mean.push_back(mesh.data(v).mean);
-
-  std::sort(mean.begin(), mean.end());
-  size_t k = (double)n * cutoff_ratio;
-  mean_min = std::min(mean[k ? k-1 : 0], 0.0);
-  mean_max = std::max(mean[n-k], 0.0);
-}
-
-void MyViewer::localSystem(const MyViewer::Vector &normal,
-                           MyViewer::Vector &u, MyViewer::Vector &v) {
-  // Generates an orthogonal (u,v) coordinate system in the plane defined by `normal`.
-  int maxi = 0, nexti = 1;
-  double max = std::abs(normal[0]), next = std::abs(normal[1]);
-  if (max < next) {
-    std::swap(max, next);
-    std::swap(maxi, nexti);
-  }
-  if (std::abs(normal[2]) > max) {
-    nexti = maxi;
-    maxi = 2;
-  } else if (std::abs(normal[2]) > next)
-    nexti = 2;
-
-  u.vectorize(0.0);
-  u[nexti] = -normal[maxi];
-  u[maxi] = normal[nexti];
-  u /= u.norm();
-  v = normal % u;
-}
-
-double MyViewer::voronoiWeight(MyViewer::MyMesh::HalfedgeHandle in_he) {
-  // Returns the area of the triangle bounded by in_he that is closest
-  // to the vertex pointed to by in_he.
-  if (mesh.is_boundary(in_he))
-    return 0;
-  auto next = mesh.next_halfedge_handle(in_he);
-  auto prev = mesh.prev_halfedge_handle(in_he);
-  double c2 = mesh.calc_edge_vector(in_he).sqrnorm();
-  double b2 = mesh.calc_edge_vector(next).sqrnorm();
-  double a2 = mesh.calc_edge_vector(prev).sqrnorm();
-  double alpha = mesh.calc_sector_angle(in_he);
-
-  if (a2 + b2 < c2)                // obtuse gamma
-    return 0.125 * b2 * std::tan(alpha);
-  if (a2 + c2 < b2)                // obtuse beta
-    return 0.125 * c2 * std::tan(alpha);
-  if (b2 + c2 < a2) {              // obtuse alpha
-    double b = std::sqrt(b2), c = std::sqrt(c2);
-    double total_area = 0.5 * b * c * std::sin(alpha);
-    double beta  = mesh.calc_sector_angle(prev);
-    double gamma = mesh.calc_sector_angle(next);
-    return total_area - 0.125 * (b2 * std::tan(gamma) + c2 * std::tan(beta));
+MyViewer::~MyViewer() {
+  mesh_shader.destroy();
+  if (buffers.vertices) {
+    GLuint names[] = { buffers.vertices, buffers.attributes, buffers.indices };
+    glDeleteBuffers(3, names);
   }
-
-  double r2 = 0.25 * a2 / std::pow(std::sin(alpha), 2); // squared circumradius
-  auto area = [r2](double x2) {
-    return 0.125 * std::sqrt(x2) * std::sqrt(std::max(4.0 * r2 - x2, 0.0));
-  };
-  return area(b2) + area(c2);
 }
 
-#ifndef BETTER_MEAN_CURVATURE
-void MyViewer::updateMeanCurvature(bool update_min_max) {
-  if (model_type == ModelType::BEZIER_SURFACE) {
-    for (auto v : mesh.vertices()) {
-      std::vector<std::vector<Vec>> der;
-      evaluate(mesh.data(v).u, mesh.data(v).v, 2, der);
-      auto E = der[1][0].squaredNorm();
-      auto F = der[1][0] * der[0][1];
-      auto G = der[0][1].squaredNorm();
-      auto n = (der[1][0] ^ der[0][1]).unit();
-      auto L = n * der[2][0];
-      auto M = n * der[1][1];
-      auto N = n * der[0][2];
-      mesh.data(v).mean = (N * E - 2 * M * F + L * G) / (2 * (E * G - F * F));
-      // mesh.data(v).gauss = (L * N - M * M) / (E * G - F * F);
-    }
+void MyViewer::updateMeanStatistics() {
+  TRACE_SCOPE("updateMeanStatistics");
+  mean_statistics.build(fields.values[displayed_field]);
+}
 
-    if (update_min_max)
-      updateMeanMinMax();
+void MyViewer::updateMeanRange() {
+  TRACE_SCOPE("updateMeanRange");
+  if (mean_statistics.size() == 0)
     return;
-  }
-
-  std::map<MyMesh::FaceHandle, double> face_area;
-  std::map<MyMesh::VertexHandle, double> vertex_area;
-
-  for (auto f : mesh.faces())
-    face_area[f] = mesh.calc_sector_area(mesh.halfedge_handle(f));
-
-  // Compute triangle strip areas
-  for (auto v : mesh.vertices()) {
-    vertex_area[v] = 0;
-    mesh.data(v).mean = 0;
-    for (auto f : mesh.vf_range(v))
-      vertex_area[v] += face_area[f];
-    vertex_area[v] /= 3.0;
-  }
-
-  // Compute mean values using dihedral angles
-  for (auto v : mesh.vertices()) {
-    for (auto h : mesh.vih_range(v)) {
-      auto vec = mesh.calc_edge_vector(h);
-      double angle = mesh.calc_dihedral_angle(h); // signed; returns 0 at the boundary
-      mesh.data(v).mean += angle * vec.norm();
-    }
-    mesh.data(v).mean *= 0.25 / vertex_area[v];
-  }
-
-  if (update_min_max)
-    updateMeanMinMax();
+  cutoffRange(cutoff_ratio, mean_min, mean_max);
 }
-#else // BETTER_MEAN_CURVATURE
-void MyViewer::updateMeanCurvature(bool update_min_max) {
-  // As in the paper:
-  //   S. Rusinkiewicz, Estimating curvatures and their derivatives on triangle meshes.
-  //     3D Data Processing, Visualization and Transmission, IEEE, 2004.
 
-  std::map<MyMesh::VertexHandle, Vector> efgp; // 2nd principal form
-  std::map<MyMesh::VertexHandle, double> wp;   // accumulated weight
-
-  // Initial setup
-  for (auto v : mesh.vertices()) {
-    efgp[v].vectorize(0.0);
-    wp[v] = 0.0;
-  }
-
-  for (auto f : mesh.faces()) {
-    // Setup local edges, vertices and normals
-    auto h0 = mesh.halfedge_handle(f);
-    auto h1 = mesh.next_halfedge_handle(h0);
-    auto h2 = mesh.next_halfedge_handle(h1);
-    auto e0 = mesh.calc_edge_vector(h0);
-    auto e1 = mesh.calc_edge_vector(h1);
-    auto e2 = mesh.calc_edge_vector(h2);
-    auto n0 = mesh.normal(mesh.to_vertex_handle(h1));
-    auto n1 = mesh.normal(mesh.to_vertex_handle(h2));
-    auto n2 = mesh.normal(mesh.to_vertex_handle(h0));
-
-    Vector n = mesh.normal(f), u, v;
-    localSystem(n, u, v);
-
-    // Solve a LSQ equation for (e,f,g) of the face
-    Eigen::MatrixXd A(6, 3);
-    A << (e0 | u), (e0 | v),    0.0,
-            0.0,   (e0 | u), (e0 | v),
-         (e1 | u), (e1 | v),    0.0,
-            0.0,   (e1 | u), (e1 | v),
-         (e2 | u), (e2 | v),    0.0,
-            0.0,   (e2 | u), (e2 | v);
-    Eigen::VectorXd b(6);
-    b << ((n2 - n1) | u),
-         ((n2 - n1) | v),
-         ((n0 - n2) | u),
-         ((n0 - n2) | v),
-         ((n1 - n0) | u),
-         ((n1 - n0) | v);
-    Eigen::Vector3d x = A.fullPivLu().solve(b);
-
-    Eigen::Matrix2d F;          // Fundamental matrix for the face
-    F << x(0), x(1),
-         x(1), x(2);
-
-    for (auto h : mesh.fh_range(f)) {
-      auto p = mesh.to_vertex_handle(h);
-
-      // Rotate the (up,vp) local coordinate system to be coplanar with that of the face
-      Vector np = mesh.normal(p), up, vp;
-      localSystem(np, up, vp);
-      auto axis = (np % n).normalize();
-      double angle = std::acos(std::min(std::max(n | np, -1.0), 1.0));
-      auto rotation = Eigen::AngleAxisd(angle, Eigen::Vector3d(axis.data()));
-      Eigen::Vector3d up1(up.data()), vp1(vp.data());
-      up1 = rotation * up1;    vp1 = rotation * vp1;
-      up = Vector(up1.data()); vp = Vector(vp1.data());
-
-      // Compute the vertex-local (e,f,g)
-      double e, f, g;
-      Eigen::Vector2d upf, vpf;
-      upf << (up | u), (up | v);
-      vpf << (vp | u), (vp | v);
-      e = upf.transpose() * F * upf;
-      f = upf.transpose() * F * vpf;
-      g = vpf.transpose() * F * vpf;
-
-      // Accumulate the results with Voronoi weights
-      double w = voronoiWeight(h);
-      efgp[p] += Vector(e, f, g) * w;
-      wp[p] += w;
-    }
-  }
+void MyViewer::cutoffRange(double ratio, double &min, double &max) const {
+  size_t n = mean_statistics.size();
+  size_t k = (double)n * ratio;
+  min = std::min(mean_statistics.nth(k ? k-1 : 0), 0.0);
+  max = std::max(mean_statistics.nth(n-k), 0.0);
+}
 
-  // Compute the principal curvatures
-  for (auto v : mesh.vertices()) {
-    auto &efg = efgp[v];
-    efg /= wp[v];
-    Eigen::Matrix2d F;
-    F << efg[0], efg[1],
-         efg[1], efg[2];
-    auto k = F.eigenvalues();   // always real, because F is a symmetric real matrix
-    mesh.data(v).mean = (k(0).real() + k(1).real()) / 2.0;
+void MyViewer::updateCurvature(bool update_min_max) {
+  TRACE_SCOPE("updateCurvature");
+  if (model_type == ModelType::BEZIER_SURFACE) {
+    patchCurvatures(mesh, patch, fields);
+    Trace::counter("evaluations", mesh.n_vertices());
   }
+  else if (curvature_estimator == CurvatureEstimator::RUSINKIEWICZ)
+    principalCurvatures(mesh, geometry, fields);
+  else
+    dihedralCurvatures(mesh, geometry, fields);
 
+  updateMeanStatistics();
   if (update_min_max)
-    updateMeanMinMax();
-}
-#endif
-
-static Vec HSV2RGB(Vec hsv) {
-  // As in Wikipedia
-  double c = hsv[2] * hsv[1];
-  double h = hsv[0] / 60;
-  double x = c * (1 - std::abs(std::fmod(h, 2) - 1));
-  double m = hsv[2] - c;
-  Vec rgb(m, m, m);
-  if (h <= 1)
-    return rgb + Vec(c, x, 0);
-  if (h <= 2)
-    return rgb + Vec(x, c, 0);
-  if (h <= 3)
-    return rgb + Vec(0, c, x);
-  if (h <= 4)
-    return rgb + Vec(0, x, c);
-  if (h <= 5)
-    return rgb + Vec(x, 0, c);
-  if (h <= 6)
-    return rgb + Vec(c, 0, x);
-  return rgb;
-}
-
-Vec MyViewer::meanMapColor(double d) const {
-  double red = 0, green = 120, blue = 240; // Hue
-  if (d < 0) {
-    double alpha = mean_min ? std::min(d / mean_min, 1.0) : 1.0;
-    return HSV2RGB({green * (1 - alpha) + blue * alpha, 1, 1});
-  }
-  double alpha = mean_max ? std::min(d / mean_max, 1.0) : 1.0;
-  return HSV2RGB({green * (1 - alpha) + red * alpha, 1, 1});
+    updateMeanRange();
+  buffers.attributes_dirty = true;
 }
 
 void MyViewer::fairMesh() {
   if (model_type != ModelType::MESH)
     return;
 
+  TRACE_SCOPE("fairMesh");
   emit startComputation(tr("Fairing mesh..."));
   OpenMesh::Smoother::JacobiLaplaceSmootherT<MyMesh> smoother(mesh);
   smoother.initialize(OpenMesh::Smoother::SmootherT<MyMesh>::Normal, // or: Tangential_and_Normal
@@ -310,47 +114,173 @@ void MyViewer::fairMesh() {
   emit endComputation();
 }
 
+void MyViewer::fairMeshImplicit() {
+  if (model_type != ModelType::MESH)
+    return;
+
+  TRACE_SCOPE("fairMeshImplicit");
+  emit startComputation(tr("Fairing mesh..."));
+  fairing.fair(mesh);
+  emit midComputation(50);
+  updateMesh(false);
+  emit endComputation();
+}
+
+void MyViewer::fitToPointCloud() {
+  if (model_type != ModelType::BEZIER_SURFACE || cloud.points.empty())
+    return;
+
+  // The parameters come from the last projection, so repeated fits correct them
+  TRACE_SCOPE("fitToPointCloud");
+  emit startComputation(tr("Fitting surface..."));
+  if (cloud_dirty)
+    projectPointCloud();
+  size_t n = cloud.points.size();
+  std::vector<double> u(n), v(n);
+  for (size_t i = 0; i < n; ++i) {
+    u[i] = cloud.projections[i].u;
+    v[i] = cloud.projections[i].v;
+  }
+  if (!fitting.fit(u, v, cloud.points, FIT_SMOOTHING, patch))
+    displayMessage(tr("Cannot fit: too few points for the degree"));
+  emit midComputation(50);
+  updateMesh(false);
+  emit endComputation();
+}
+
 void MyViewer::updateVertexNormals() {
+  TRACE_SCOPE("updateVertexNormals");
   if (model_type == ModelType::BEZIER_SURFACE) {
-    for (auto v : mesh.vertices()) {
-      std::vector<std::vector<Vec>> der;
-      evaluate(mesh.data(v).u, mesh.data(v).v, 1, der);
-      Vector n(static_cast<double *>(der[0][1] ^ der[1][0]));
-      double len = n.length();
-      if (len != 0.0)
-        n /= len;
-      mesh.set_normal(v, n);
-    }
+    Trace::counter("evaluations", mesh.n_vertices());
+    patchNormals(patch, mesh);
     return;
   }
 
-  // Weights according to:
-  //   N. Max, Weights for computing vertex normals from facet normals.
-  //     Journal of Graphics Tools, Vol. 4(2), 1999.
-  for (auto v : mesh.vertices()) {
-    Vector n(0.0, 0.0, 0.0);
-    for (auto h : mesh.vih_range(v)) {
-      if (mesh.is_boundary(h))
-        continue;
-      auto in_vec  = mesh.calc_edge_vector(h);
-      auto out_vec = mesh.calc_edge_vector(mesh.next_halfedge_handle(h));
-      double w = in_vec.sqrnorm() * out_vec.sqrnorm();
-      n += (in_vec % out_vec) / (w == 0.0 ? 1.0 : w);
-    }
-    double len = n.length();
-    if (len != 0.0)
-      n /= len;
-    mesh.set_normal(v, n);
+  int nv = mesh.n_vertices();
+#pragma omp parallel for
+  for (int i = 0; i < nv; ++i) {
+    MyMesh::VertexHandle v(i);
+    mesh.set_normal(v, vertexNormal(mesh, geometry, v));
   }
 }
 
-void MyViewer::updateMesh(bool update_mean_range) {
-  if (model_type == ModelType::BEZIER_SURFACE)
+void MyViewer::updateMesh(bool update_mean_range, bool cached) {
+  TRACE_SCOPE("updateMesh");
+  // A cached tessellation comes with its normals and curvature
+  cached = cached && model_type == ModelType::BEZIER_SURFACE;
+  bool hit = cached && tessellation_cache.load(patch, 50, Precision::SINGLE, mesh, fields);
+  if (model_type == ModelType::BEZIER_SURFACE && !hit)
     generateMesh(50);
   mesh.request_face_normals(); mesh.request_vertex_normals();
   mesh.update_face_normals(); //mesh.update_vertex_normals();
-  updateVertexNormals();
-  updateMeanCurvature(update_mean_range);
+  if (model_type == ModelType::MESH)
+    geometry.update(mesh);
+  if (hit) {
+    updateMeanStatistics();
+    if (update_mean_range)
+      updateMeanRange();
+  } else {
+    updateVertexNormals();
+    updateCurvature(update_mean_range);
+    if (cached)
+      tessellation_cache.store(patch, 50, Precision::SINGLE, mesh, fields);
+  }
+  buffers.geometry_dirty = buffers.topology_dirty = buffers.attributes_dirty = true;
+  picking_dirty = intersector_dirty = contours_dirty = cloud_dirty = true;
+  incremental_dirty = true;
+  Trace::counter("vertices", mesh.n_vertices());
+  Trace::counter("faces", mesh.n_faces());
+  Trace::counter("allocations", EvaluationWorkspace::allocations());
+}
+
+bool MyViewer::updateMeshIncrementally(const Patch &new_patch) {
+  TRACE_SCOPE("updateMeshIncrementally");
+  // The incremental tessellation follows the displayed one, and is only built when needed
+  // (it costs about as much as a full update, while each later update is much cheaper)
+  if (incremental_dirty) {
+    incremental.build(patch, 50);
+    incremental_dirty = false;
+  }
+  std::vector<MyMesh::VertexHandle> changed;
+  if (!incremental.update(new_patch, mesh, fields, changed))
+    return false;
+  patch = new_patch;
+  Trace::counter("changed vertices", changed.size());
+  if (changed.empty())
+    return true;
+
+  mesh.update_face_normals();
+  // Both bases have global support, so usually (almost) every vertex changes
+  if (changed.size() > mesh.n_vertices() / 4) {
+    updateMeanStatistics();
+    buffers.geometry_dirty = buffers.attributes_dirty = true;
+  } else {
+    const auto &values = fields.values[displayed_field];
+    for (auto v : changed)
+      mean_statistics.update(v.idx(), values[v.idx()]);
+    buffers.dirty_vertices.insert(buffers.dirty_vertices.end(), changed.begin(), changed.end());
+  }
+  picking_dirty = intersector_dirty = contours_dirty = cloud_dirty = true;
+  return true;
+}
+
+void MyViewer::projectPointCloud() {
+  TRACE_SCOPE("projectPointCloud");
+  cloud_dirty = false;
+  projector.build(patch);
+  projector.project(cloud.points, cloud.projections);
+
+  size_t n = cloud.points.size();
+  double max_deviation = 0.0, sum2 = 0.0;
+  for (const auto &r : cloud.projections) {
+    max_deviation = std::max(max_deviation, std::abs(r.distance));
+    sum2 += r.distance * r.distance;
+  }
+  cloud.colors.resize(3 * n);
+  for (size_t i = 0; i < n; ++i) {
+    double d = cloud.projections[i].distance;
+    auto color = MeshShader::meanMapColor(max_deviation > 0.0 ? d / max_deviation : 0.0);
+    for (size_t j = 0; j < 3; ++j)
+      cloud.colors[3*i+j] = color[j];
+  }
+  displayMessage(tr("Deviation: max %1, RMS %2").arg(max_deviation).arg(std::sqrt(sum2 / n)));
+}
+
+void MyViewer::updateMeshLocally(MyMesh::VertexHandle moved) {
+  TRACE_SCOPE("updateMeshLocally");
+  // Only the neighborhood of the moved vertex changes (and the color range):
+  // - face normals in its 1-ring
+  // - vertex normals and dihedral curvatures in its 1-ring
+  // - Rusinkiewicz curvatures in its 2-ring (as it depends on the neighbors' normals)
+  for (auto f : mesh.vf_range(moved))
+    mesh.set_normal(f, mesh.calc_face_normal(f));
+  geometry.update(mesh, moved);
+
+  std::vector<MyMesh::VertexHandle> ring = { moved };
+  for (auto v : mesh.vv_range(moved))
+    ring.push_back(v);
+  for (auto v : ring)
+    mesh.set_normal(v, vertexNormal(mesh, geometry, v));
+
+  if (curvature_estimator == CurvatureEstimator::DIHEDRAL)
+    dihedralCurvatures(mesh, geometry, ring, fields);
+  else {
+    auto ring1 = ring;
+    for (size_t i = 1; i < ring1.size(); ++i)
+      for (auto v : mesh.vv_range(ring1[i]))
+        ring.push_back(v);
+    std::sort(ring.begin(), ring.end());
+    ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+    principalCurvatures(mesh, geometry, ring, fields);
+  }
+
+  const auto &values = fields.values[displayed_field];
+  for (auto v : ring)
+    mean_statistics.update(v.idx(), values[v.idx()]);
+  updateMeanRange();
+  buffers.dirty_vertices.insert(buffers.dirty_vertices.end(), ring.begin(), ring.end());
+  if (!contours_dirty)
+    contours.update(mesh, { moved });
 }
 
 void MyViewer::setupCamera() {
@@ -373,161 +303,311 @@ void MyViewer::setupCamera() {
 }
 
 bool MyViewer::openMesh(const std::string &filename, bool update_view) {
-  if (!OpenMesh::IO::read_mesh(mesh, filename) || mesh.n_vertices() == 0)
+  TRACE_SCOPE("openMesh");
+  computation_cancelled = false;
+  emit startComputation(tr("Loading mesh..."), true);
+  // Loaded separately, so that the current model is kept on failure or cancellation
+  MyMesh loaded;
+  auto result = MeshLoader::load(filename, loaded, [&](int percent) {
+      emit midComputation(percent);
+      return !computation_cancelled;
+    });
+  emit endComputation();
+  if (result == MeshLoader::Result::UNSUPPORTED && !OpenMesh::IO::read_mesh(loaded, filename))
+    result = MeshLoader::Result::ERROR;
+  if (result == MeshLoader::Result::CANCELLED || result == MeshLoader::Result::ERROR ||
+      loaded.n_vertices() == 0)
     return false;
+  mesh = std::move(loaded);
   model_type = ModelType::MESH;
+  cloud = PointCloud();
   last_filename = filename;
+  if (watching)
+    setWatching(true);
   updateMesh(update_view);
   if (update_view)
     setupCamera();
   return true;
 }
 
+void MyViewer::cancelComputation() {
+  computation_cancelled = true;
+}
+
+void MyViewer::setWatching(bool on) {
+  watching = on;
+  if (!watcher.files().empty())
+    watcher.removePaths(watcher.files());
+  if (!watcher.directories().empty())
+    watcher.removePaths(watcher.directories());
+  reload_timer.stop();
+  if (on && !last_filename.empty()) {
+    // The directory is watched as well, to notice when the file is created again
+    QFileInfo info(QString::fromStdString(last_filename));
+    watched_modified = info.lastModified();
+    watcher.addPath(info.absolutePath());
+    if (info.exists())
+      watcher.addPath(info.filePath());
+  }
+}
+
+void MyViewer::watchedFileChanged() {
+  reload_timer.start();
+}
+
+void MyViewer::watchedDirectoryChanged() {
+  // Changes of other files in the directory are ignored
+  QFileInfo info(QString::fromStdString(last_filename));
+  if (watching && info.exists() && info.lastModified() != watched_modified)
+    reload_timer.start();
+}
+
+void MyViewer::reloadWatchedFile() {
+  if (!watching || last_filename.empty())
+    return;
+  auto filename = QString::fromStdString(last_filename);
+  QFileInfo info(filename);
+  if (!info.exists())
+    return;                     // deleted; its directory signals when it is written again
+  watched_modified = info.lastModified();
+  // Watched again, as a file that was deleted or replaced by a rename is not the one watched
+  if (watcher.files().contains(filename))
+    watcher.removePath(filename);
+  watcher.addPath(filename);
+
+  TRACE_SCOPE("reloadWatchedFile");
+  if (model_type == ModelType::MESH)
+    openMesh(last_filename, false);
+  else if (model_type == ModelType::BEZIER_SURFACE) {
+    // A partially written file is ignored, the end of the write will trigger another reload
+    // Text files have no basis, the current one is kept (as when reopening by key R)
+    Patch new_patch;
+    new_patch.trigonometric = patch.trigonometric;
+    bool ok = PatchFile::isBinary(last_filename) ? PatchFile::read(last_filename, new_patch)
+                                                 : PatchFile::readText(last_filename, new_patch);
+    if (!ok)
+      return;
+    if (!updateMeshIncrementally(new_patch)) {
+      patch = new_patch;
+      updateMesh(false, true);
+    }
+  }
+  update();
+}
+
 bool MyViewer::openBezier(const std::string &filename, bool update_view) {
-  size_t n, m;
-  try {
-    std::ifstream f(filename.c_str());
-    f.exceptions(std::ios::failbit | std::ios::badbit);
-    f >> n >> m;
-    degree[0] = n++; degree[1] = m++;
-    control_points.resize(n * m);
-    for (size_t i = 0, index = 0; i < n; ++i)
-      for (size_t j = 0; j < m; ++j, ++index)
-        f >> control_points[index][0] >> control_points[index][1] >> control_points[index][2];
-  } catch(std::ifstream::failure &) {
+  TRACE_SCOPE("openBezier");
+  bool ok = PatchFile::isBinary(filename) ? PatchFile::read(filename, patch)
+                                          : PatchFile::readText(filename, patch);
+  if (!ok)
     return false;
-  }
   model_type = ModelType::BEZIER_SURFACE;
   last_filename = filename;
-  updateMesh(update_view);
+  if (watching)
+    setWatching(true);
+  updateMesh(update_view, true);
   if (update_view)
     setupCamera();
   return true;
 }
 
-bool MyViewer::saveBezier(const std::string &filename) {
+bool MyViewer::saveContours(const std::string &filename) {
+  if (model_type == ModelType::NONE)
+    return false;
+  updateContours();
+  return contours.save(filename);
+}
+
+bool MyViewer::exportMesh(const std::string &filename) {
+  if (model_type == ModelType::NONE)
+    return false;
+  TRACE_SCOPE("exportMesh");
+  const auto &mean = fields.values[CurvatureFields::MEAN];
+  MeshExport::Attributes attributes;
+  attributes.parameters = model_type == ModelType::BEZIER_SURFACE;
+  attributes.mean = mean.size() == mesh.n_vertices();
+  return MeshExport::save(filename, mesh, mean, attributes);
+}
+
+bool MyViewer::exportTessellation(const std::string &filename, size_t resolution) {
   if (model_type != ModelType::BEZIER_SURFACE)
     return false;
+  TRACE_SCOPE("exportTessellation");
+  emit startComputation(tr("Exporting tessellation..."));
+  bool ok = MeshExport::saveTessellation(filename, patch, resolution, MeshExport::Attributes());
+  emit endComputation();
+  return ok;
+}
 
-  try {
-    std::ofstream f(filename.c_str());
-    f.exceptions(std::ios::failbit | std::ios::badbit);
-    f << degree[0] << ' ' << degree[1] << std::endl;
-    for (const auto &p : control_points)
-      f << p[0] << ' ' << p[1] << ' ' << p[2] << std::endl;
-  } catch(std::ifstream::failure &) {
+bool MyViewer::openPointCloud(const std::string &filename) {
+  // Any mesh format can be used, only the vertices are read
+  TRACE_SCOPE("openPointCloud");
+  MyMesh points;
+  if (model_type != ModelType::BEZIER_SURFACE ||
+      !OpenMesh::IO::read_mesh(points, filename) || points.n_vertices() == 0)
     return false;
-  }
+  emit startComputation(tr("Projecting points..."));
+  cloud.points.clear();
+  cloud.points.reserve(points.n_vertices());
+  for (auto v : points.vertices())
+    cloud.points.push_back(points.point(v));
+  projectPointCloud();
+  emit endComputation();
+  update();
   return true;
 }
 
+bool MyViewer::saveBezier(const std::string &filename) {
+  if (model_type != ModelType::BEZIER_SURFACE)
+    return false;
+  return PatchFile::isBinary(filename) ? PatchFile::write(filename, { patch })
+                                       : PatchFile::writeText(filename, patch);
+}
+
 void MyViewer::init() {
+  initializeOpenGLFunctions();
   glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, 1);
 
-  QImage img(":/isophotes.png");
-  glGenTextures(1, &isophote_texture);
-  glBindTexture(GL_TEXTURE_2D, isophote_texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, img.width(), img.height(), 0, GL_BGRA,
-               GL_UNSIGNED_BYTE, img.convertToFormat(QImage::Format_ARGB32).bits());
-
-  QImage img2(":/environment.png");
-  glGenTextures(1, &environment_texture);
-  glBindTexture(GL_TEXTURE_2D, environment_texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, img2.width(), img2.height(), 0, GL_BGRA,
-               GL_UNSIGNED_BYTE, img2.convertToFormat(QImage::Format_ARGB32).bits());
-
-  glGenTextures(1, &slicing_texture);
-  glBindTexture(GL_TEXTURE_1D, slicing_texture);
-  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  static const unsigned char slicing_img[] = { 0b11111111, 0b00011100 };
-  glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB, 2, 0, GL_RGB, GL_UNSIGNED_BYTE_3_3_2, &slicing_img);
+  mesh_shader.init();
+
+  GLuint names[3];
+  glGenBuffers(3, names);
+  buffers.vertices = names[0];
+  buffers.attributes = names[1];
+  buffers.indices = names[2];
+}
+
+void MyViewer::updateBuffers() {
+  TRACE_SCOPE("updateBuffers");
+  // Positions and normals are interleaved, the curvature values are stored separately.
+  auto vertexData = [&](MyMesh::VertexHandle v, GLfloat *d) {
+    const auto &p = mesh.point(v);
+    const auto &n = mesh.normal(v);
+    d[0] = p[0]; d[1] = p[1]; d[2] = p[2];
+    d[3] = n[0]; d[4] = n[1]; d[5] = n[2];
+  };
+  if (buffers.geometry_dirty) {
+    std::vector<GLfloat> data(mesh.n_vertices() * 6);
+    for (auto v : mesh.vertices())
+      vertexData(v, &data[v.idx() * 6]);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.vertices);
+    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(GLfloat), data.data(), GL_DYNAMIC_DRAW);
+  } else if (!buffers.dirty_vertices.empty()) {
+    // Local modification: only the changed vertices are uploaded
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.vertices);
+    for (auto v : buffers.dirty_vertices) {
+      GLfloat d[6];
+      vertexData(v, d);
+      glBufferSubData(GL_ARRAY_BUFFER, v.idx() * sizeof(d), sizeof(d), d);
+    }
+  }
+
+  if (buffers.topology_dirty) {
+    std::vector<GLuint> indices;
+    indices.reserve(mesh.n_faces() * 3);
+    for (auto f : mesh.faces())
+      for (auto v : mesh.fv_range(f))
+        indices.push_back(v.idx());
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.indices);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(),
+                 GL_STATIC_DRAW);
+    buffers.n_indices = indices.size();
+  }
+
+  // The only per-vertex attribute of the visualization is the displayed curvature field,
+  // everything else is computed in the shaders
+  const auto &values = fields.values[displayed_field];
+  if (buffers.attributes_dirty) {
+    std::vector<GLfloat> data(values.begin(), values.end());
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.attributes);
+    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(GLfloat), data.data(), GL_DYNAMIC_DRAW);
+  } else if (!buffers.dirty_vertices.empty()) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.attributes);
+    for (auto v : buffers.dirty_vertices) {
+      GLfloat value = values[v.idx()];
+      glBufferSubData(GL_ARRAY_BUFFER, v.idx() * sizeof(GLfloat), sizeof(GLfloat), &value);
+    }
+  }
+  buffers.dirty_vertices.clear();
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  buffers.geometry_dirty = buffers.topology_dirty = buffers.attributes_dirty = false;
+}
+
+void MyViewer::drawBuffers(bool attributes) {
+  // The same buffers are used both for the solid and the wireframe view
+  glBindBuffer(GL_ARRAY_BUFFER, buffers.vertices);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, 6 * sizeof(GLfloat), nullptr);
+  if (attributes) {
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glNormalPointer(GL_FLOAT, 6 * sizeof(GLfloat), reinterpret_cast<void *>(3 * sizeof(GLfloat)));
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.attributes);
+    glEnableVertexAttribArray(MeshShader::CURVATURE_ATTRIBUTE);
+    glVertexAttribPointer(MeshShader::CURVATURE_ATTRIBUTE, 1, GL_FLOAT, GL_FALSE, 0, nullptr);
+  }
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.indices);
+  glDrawElements(GL_TRIANGLES, buffers.n_indices, GL_UNSIGNED_INT, nullptr);
+
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableVertexAttribArray(MeshShader::CURVATURE_ATTRIBUTE);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void MyViewer::draw() {
+  TRACE_SCOPE("draw");
   if (model_type == ModelType::BEZIER_SURFACE && show_control_points)
     drawControlNet();
+  if (!cloud.points.empty()) {
+    // Reprojecting a large cloud on every step of a drag would be too slow
+    if (cloud_dirty && !axes.dragging && model_type == ModelType::BEZIER_SURFACE)
+      projectPointCloud();
+    drawPointCloud();
+  }
+
+  updateBuffers();
 
   glPolygonMode(GL_FRONT_AND_BACK, !show_solid && show_wireframe ? GL_LINE : GL_FILL);
   glEnable(GL_POLYGON_OFFSET_FILL);
   glPolygonOffset(1, 1);
 
   if (show_solid || show_wireframe) {
-    if (visualization == Visualization::PLAIN)
-      glColor3d(1.0, 1.0, 1.0);
-    else if (visualization == Visualization::ISOPHOTES) {
-      glBindTexture(GL_TEXTURE_2D, current_isophote_texture);
-      glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_DECAL);
-      glEnable(GL_TEXTURE_2D);
-      glTexGeni(GL_S, GL_TEXTURE_GEN_MODE, GL_SPHERE_MAP);
-      glTexGeni(GL_T, GL_TEXTURE_GEN_MODE, GL_SPHERE_MAP);
-      glEnable(GL_TEXTURE_GEN_S);
-      glEnable(GL_TEXTURE_GEN_T);
-    } else if (visualization == Visualization::SLICING) {
-      glBindTexture(GL_TEXTURE_1D, slicing_texture);
-      glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_DECAL);
-      glEnable(GL_TEXTURE_1D);
-    }
-    for (auto f : mesh.faces()) {
-      glBegin(GL_POLYGON);
-      for (auto v : mesh.fv_range(f)) {
-        if (visualization == Visualization::MEAN)
-          glColor3dv(meanMapColor(mesh.data(v).mean));
-        else if (visualization == Visualization::SLICING)
-          glTexCoord1d(mesh.point(v) | slicing_dir * slicing_scaling);
-        glNormal3dv(mesh.normal(v).data());
-        glVertex3dv(mesh.point(v).data());
-      }
-      glEnd();
-    }
-    if (visualization == Visualization::ISOPHOTES) {
-      glDisable(GL_TEXTURE_GEN_S);
-      glDisable(GL_TEXTURE_GEN_T);
-      glDisable(GL_TEXTURE_2D);
-      glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-    } else if (visualization == Visualization::SLICING) {
-      glDisable(GL_TEXTURE_1D);
-    }
+    mesh_shader.bind(visualization, environment_map, mean_min, mean_max,
+                     slicing_dir * slicing_scaling);
+    drawBuffers(true);
+    mesh_shader.release();
   }
 
   if (show_solid && show_wireframe) {
     glPolygonMode(GL_FRONT, GL_LINE);
     glColor3d(0.0, 0.0, 0.0);
     glDisable(GL_LIGHTING);
-    for (auto f : mesh.faces()) {
-      glBegin(GL_POLYGON);
-      for (auto v : mesh.fv_range(f))
-        glVertex3dv(mesh.point(v).data());
-      glEnd();
-    }
+    drawBuffers(false);
     glEnable(GL_LIGHTING);
   }
 
+  if (show_contours && model_type != ModelType::NONE)
+    drawContours();
+
   if (axes.shown)
     drawAxes();
 }
 
-void MyViewer::drawControlNet() const {
+void MyViewer::drawControlNet() {
   glDisable(GL_LIGHTING);
   glLineWidth(3.0);
   glColor3d(0.3, 0.3, 1.0);
-  size_t m = degree[1] + 1;
+  size_t m = patch.degree[1] + 1;
   for (size_t k = 0; k < 2; ++k)
-    for (size_t i = 0; i <= degree[k]; ++i) {
+    for (size_t i = 0; i <= patch.degree[k]; ++i) {
       glBegin(GL_LINE_STRIP);
-      for (size_t j = 0; j <= degree[1-k]; ++j) {
+      for (size_t j = 0; j <= patch.degree[1-k]; ++j) {
         size_t const index = k ? j * m + i : i * m + j;
-        const auto &p = control_points[index];
-        glVertex3dv(p);
+        const auto &p = patch.control_points[index];
+        glVertex3dv(p.data());
       }
       glEnd();
     }
@@ -535,14 +615,52 @@ void MyViewer::drawControlNet() const {
   glPointSize(8.0);
   glColor3d(1.0, 0.0, 1.0);
   glBegin(GL_POINTS);
-  for (const auto &p : control_points)
-    glVertex3dv(p);
+  for (const auto &p : patch.control_points)
+    glVertex3dv(p.data());
   glEnd();
   glPointSize(1.0);
   glEnable(GL_LIGHTING);
 }
 
-void MyViewer::drawAxes() const {
+void MyViewer::updateContours() {
+  if (!contours_dirty)
+    return;
+  TRACE_SCOPE("updateContours");
+  contours.extract(mesh, slicing_dir, slicing_scaling);
+  contours_dirty = false;
+}
+
+void MyViewer::drawContours() {
+  updateContours();
+  glDisable(GL_LIGHTING);
+  glLineWidth(2.0);
+  glColor3d(0.0, 0.0, 0.0);
+  contours.forEach([this](const Contours::Polyline &line) {
+      glBegin(line.closed ? GL_LINE_LOOP : GL_LINE_STRIP);
+      for (const auto &p : line.points)
+        glVertex3dv(p.data());
+      glEnd();
+    });
+  glLineWidth(1.0);
+  glEnable(GL_LIGHTING);
+}
+
+void MyViewer::drawPointCloud() {
+  // Colored by the signed deviation from the surface
+  glDisable(GL_LIGHTING);
+  glPointSize(3.0);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glVertexPointer(3, GL_DOUBLE, 0, cloud.points.data());
+  glColorPointer(3, GL_FLOAT, 0, cloud.colors.data());
+  glDrawArrays(GL_POINTS, 0, cloud.points.size());
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glPointSize(1.0);
+  glEnable(GL_LIGHTING);
+}
+
+void MyViewer::drawAxes() {
   const Vec &p = axes.position;
   glColor3d(1.0, 0.0, 0.0);
   drawArrow(p, p + Vec(axes.size, 0.0, 0.0), axes.size / 50.0);
@@ -553,35 +671,50 @@ void MyViewer::drawAxes() const {
   glEnd();
 }
 
-void MyViewer::drawWithNames() {
+void MyViewer::select(const QPoint &point) {
+  // Picking is done on the CPU, instead of rendering names in GL_SELECT mode
+  setSelectedName(pick(point));
+  postSelection(point);
+}
+
+int MyViewer::pick(const QPoint &point) {
   if (axes.shown)
-    return;//return drawAxesWithNames();
+    return -1;
 
   switch (model_type) {
-  case ModelType::NONE: break;
+  case ModelType::NONE: return -1;
   case ModelType::MESH:
     if (!show_wireframe)
-      return;
-    for (auto v : mesh.vertices()) {
-      glPushName(v.idx());
-      glRasterPos3dv(mesh.point(v).data());
-      glPopName();
+      return -1;
+    if (picking_dirty) {
+      std::vector<Vector> points(mesh.n_vertices());
+      for (auto v : mesh.vertices())
+        points[v.idx()] = mesh.point(v);
+      picking_index.build(points);
     }
     break;
   case ModelType::BEZIER_SURFACE:
     if (!show_control_points)
-      return;
-    for (size_t i = 0, ie = control_points.size(); i < ie; ++i) {
-      Vec const &p = control_points[i];
-      glPushName(i);
-      glRasterPos3fv(p);
-      glPopName();
-    }
+      return -1;
+    if (picking_dirty)
+      picking_index.build(patch.control_points);
     break;
   }
+  picking_dirty = false;
+
+  // The selection region is a cone around the ray
+  Vec from, dir;
+  camera()->convertClickToLine(point, from, dir);
+  double tolerance = selectRegionWidth() / 2.0, radius = 0.0, slope = 0.0;
+  if (camera()->type() == qglviewer::Camera::ORTHOGRAPHIC)
+    radius = tolerance * camera()->pixelGLRatio(camera()->sceneCenter());
+  else
+    slope = tolerance * camera()->pixelGLRatio(camera()->position() + camera()->viewDirection());
+  return picking_index.pick(Vector(from[0], from[1], from[2]),
+                            Vector(dir[0], dir[1], dir[2]).normalized(), radius, slope);
 }
 
-void MyViewer::drawAxesWithNames() const {
+void MyViewer::drawAxesWithNames() {
   const Vec &p = axes.position;
   glPushName(0);
   drawArrow(p, p + Vec(axes.size, 0.0, 0.0), axes.size / 50.0);
@@ -598,16 +731,18 @@ void MyViewer::postSelection(const QPoint &p) {
   int sel = selectedName();
   if (sel == -1) {
     axes.shown = false;
+    if (model_type == ModelType::BEZIER_SURFACE)
+      probe(p);
     return;
   }
 
   if (axes.shown) {
+    // Grab the point of the axis nearest to the ray, instead of reading back the depth
     axes.selected_axis = sel;
-    bool found;
-    axes.grabbed_pos = camera()->pointUnderPixel(p, found);
+    Vec from, dir, axis(sel == 0, sel == 1, sel == 2);
+    camera()->convertClickToLine(p, from, dir);
+    axes.grabbed_pos = intersectLines(axes.position, axis, from, dir);
     axes.original_pos = axes.position;
-    if (!found)
-      axes.shown = false;
     return;
   }
 
@@ -615,7 +750,7 @@ void MyViewer::postSelection(const QPoint &p) {
   if (model_type == ModelType::MESH)
     axes.position = Vec(mesh.point(MyMesh::VertexHandle(sel)).data());
   if (model_type == ModelType::BEZIER_SURFACE)
-    axes.position = control_points[sel];
+    axes.position = Vec(patch.control_points[sel].data());
   double depth = camera()->projectedCoordinatesOf(axes.position)[2];
   Vec q1 = camera()->unprojectedCoordinatesOf(Vec(0.0, 0.0, depth));
   Vec q2 = camera()->unprojectedCoordinatesOf(Vec(width(), height(), depth));
@@ -655,12 +790,12 @@ void MyViewer::keyPressEvent(QKeyEvent *e) {
       break;
     case Qt::Key_I:
       visualization = Visualization::ISOPHOTES;
-      current_isophote_texture = isophote_texture;
+      environment_map = false;
       update();
       break;
     case Qt::Key_E:
       visualization = Visualization::ISOPHOTES;
-      current_isophote_texture = environment_texture;
+      environment_map = true;
       update();
       break;
     case Qt::Key_C:
@@ -675,27 +810,35 @@ void MyViewer::keyPressEvent(QKeyEvent *e) {
       show_wireframe = !show_wireframe;
       update();
       break;
+    case Qt::Key_K:
+      if (curvature_estimator == CurvatureEstimator::DIHEDRAL)
+        curvature_estimator = CurvatureEstimator::RUSINKIEWICZ;
+      else
+        curvature_estimator = CurvatureEstimator::DIHEDRAL;
+      updateCurvature();
+      update();
+      break;
     case Qt::Key_F:
       fairMesh();
       update();
       break;
     case Qt::Key_U:
-      elevateU();
+      patch.elevateU();
       updateMesh();
       update();
       break;
     case Qt::Key_V:
-      elevateV();
+      patch.elevateV();
       updateMesh();
       update();
       break;
     case Qt::Key_T:
-      trigonometric_basis = true;
+      patch.trigonometric = true;
       updateMesh();
       update();
       break;
     case Qt::Key_B:
-      trigonometric_basis = false;
+      patch.trigonometric = false;
       updateMesh();
       update();
       break;
@@ -706,17 +849,53 @@ void MyViewer::keyPressEvent(QKeyEvent *e) {
     switch (e->key()) {
     case Qt::Key_Plus:
       slicing_scaling *= 2;
+      contours_dirty = true;
       update();
       break;
     case Qt::Key_Minus:
       slicing_scaling /= 2;
+      contours_dirty = true;
       update();
       break;
     case Qt::Key_Asterisk:
       slicing_dir = Vector(static_cast<double *>(camera()->viewDirection()));
+      contours_dirty = true;
+      update();
+      break;
+    }
+  else if (e->modifiers() == Qt::ShiftModifier)
+    switch (e->key()) {
+    case Qt::Key_F:
+      fairMeshImplicit();
+      update();
+      break;
+    case Qt::Key_P:
+      fitToPointCloud();
       update();
       break;
-    } else
+    case Qt::Key_L:
+      show_contours = !show_contours;
+      update();
+      break;
+    case Qt::Key_M:
+      // All fields are already computed, skip those not available for this model
+      for (int i = 0; i < CurvatureFields::N_FIELDS; ++i) {
+        displayed_field =
+          static_cast<CurvatureFields::Field>((displayed_field + 1) % CurvatureFields::N_FIELDS);
+        updateMeanStatistics();
+        if (mean_statistics.size() > 0)
+          break;
+      }
+      updateMeanRange();
+      buffers.attributes_dirty = true;
+      visualization = Visualization::MEAN;
+      displayMessage(tr("Curvature map: %1").arg(CurvatureFields::name(displayed_field)));
+      update();
+      break;
+    default:
+      QGLViewer::keyPressEvent(e);
+    }
+  else
     QGLViewer::keyPressEvent(e);
 }
 
@@ -730,129 +909,27 @@ Vec MyViewer::intersectLines(const Vec &ap, const Vec &ad, const Vec &bp, const
   return ap + s * ad;
 }
 
-static void bernstein(size_t n, double u, std::vector<double> &coeff) {
-  coeff.clear(); coeff.reserve(n + 1);
-  coeff.push_back(1.0);
-  double u1 = 1.0 - u;
-  for (size_t j = 1; j <= n; ++j) {
-    double saved = 0.0;
-    for (size_t k = 0; k < j; ++k) {
-      double tmp = coeff[k];
-      coeff[k] = saved + tmp * u1;
-      saved = tmp * u;
-    }
-    coeff.push_back(saved);
+void MyViewer::probe(const QPoint &point) {
+  if (intersector_dirty) {
+    intersector.build(patch);
+    intersector_dirty = false;
   }
-}
-
-static void bernstein(size_t n, double u, size_t derivatives,
-                      std::vector<std::vector<double>> &coeffs) {
-  // Assumes derivatives <= n
-  std::vector<double> coeff;
-  bernstein(n, u, coeff);
-  coeffs.clear();
-  coeffs.push_back(coeff);
-  if (derivatives == 0)
+  Vec from, dir;
+  camera()->convertClickToLine(point, from, dir);
+  PatchIntersector::Hit hit;
+  if (!intersector.intersect(Vector(from[0], from[1], from[2]),
+                             Vector(dir[0], dir[1], dir[2]), hit))
     return;
-
-  std::vector<std::vector<double>> rec;
-  bernstein(n - 1, u, derivatives - 1, rec);
-  for (size_t i = 1; i <= derivatives; ++i) {
-    const auto &last = rec[i-1];
-    std::vector<double> tmp;
-    tmp.push_back(n * -last[0]);
-    for (size_t j = 1; j < n; ++j)
-      tmp.push_back(n * (last[j-1] - last[j]));
-    tmp.push_back(n * last[n-1]);
-    coeffs.push_back(tmp);
-  }
-}
-
-Vec MyViewer::evaluate(double u, double v, size_t derivatives,
-                       std::vector<std::vector<Vec>> &der) {
-  size_t n = degree[0], m = degree[1];
-  std::vector<std::vector<double>> coeff_u, coeff_v;
-  if (trigonometric_basis) {
-    trigobasis(n, u, derivatives, coeff_u);
-    trigobasis(m, v, derivatives, coeff_v);
-  } else {
-    bernstein(n, u, derivatives, coeff_u);
-    bernstein(m, v, derivatives, coeff_v);
-  }
-  der.resize(derivatives + 1);
-  for (size_t i = 0; i <= derivatives; ++i)
-    der[i] = std::vector<Vec>(derivatives + 1, Vec(0, 0, 0));
-  for (size_t i = 0; i <= derivatives; ++i)
-    for (size_t j = 0; j <= derivatives; ++j)
-      for (size_t k = 0, index = 0; k <= n; ++k)
-        for (size_t l = 0; l <= m; ++l, ++index)
-          der[i][j] += control_points[index] * coeff_u[i][k] * coeff_v[j][l];
-  return der[0][0];
-}
-
-Vec MyViewer::evaluate(double u, double v) {
-  static std::vector<std::vector<Vec>> dummy;
-  return evaluate(u, v, 0, dummy);
+  displayMessage(tr("(u, v) = (%1, %2), point = (%3, %4, %5), normal = (%6, %7, %8)")
+                 .arg(hit.u).arg(hit.v)
+                 .arg(hit.point[0]).arg(hit.point[1]).arg(hit.point[2])
+                 .arg(hit.normal[0]).arg(hit.normal[1]).arg(hit.normal[2]), 5000);
 }
 
 void MyViewer::generateMesh(size_t resolution) {
-  mesh.clear();
-  std::vector<MyMesh::VertexHandle> handles, tri;
-
-  for (size_t i = 0; i < resolution; ++i) {
-    double u = (double)i / (double)(resolution - 1);
-    for (size_t j = 0; j < resolution; ++j) {
-      double v = (double)j / (double)(resolution - 1);
-      auto p = evaluate(u, v);
-      handles.push_back(mesh.add_vertex(Vector(static_cast<double *>(p))));
-      mesh.data(handles.back()).u = u;
-      mesh.data(handles.back()).v = v;
-    }
-  }
-  for (size_t i = 0; i < resolution - 1; ++i)
-    for (size_t j = 0; j < resolution - 1; ++j) {
-      tri.clear();
-      tri.push_back(handles[i * resolution + j]);
-      tri.push_back(handles[i * resolution + j + 1]);
-      tri.push_back(handles[(i + 1) * resolution + j]);
-      mesh.add_face(tri);
-      tri.clear();
-      tri.push_back(handles[(i + 1) * resolution + j]);
-      tri.push_back(handles[i * resolution + j + 1]);
-      tri.push_back(handles[(i + 1) * resolution + j + 1]);
-      mesh.add_face(tri);
-    }
-}
-
-void MyViewer::elevateU() {
-  std::vector<Vec> tmp;
-  for (size_t j = 0; j <= degree[1]; ++j)
-    tmp.push_back(control_points[j]);
-  for (size_t i = 1, index = degree[1] + 1; i <= degree[0]; ++i) {
-    double ratio = (double)i / (degree[0] + 1);
-    for (size_t j = 0; j <= degree[1]; ++j, ++index)
-      tmp.push_back(control_points[index-degree[1]-1] * ratio +
-                    control_points[index] * (1 - ratio));
-  }
-  for (size_t j = 0, base = degree[0] * (degree[1] + 1); j <= degree[1]; ++j)
-    tmp.push_back(control_points[base+j]);
-  control_points = tmp;
-  degree[0]++;
-}
-
-void MyViewer::elevateV() {
-  std::vector<Vec> tmp;
-  for (size_t i = 0, index = 0; i <= degree[0]; ++i) {
-    tmp.push_back(control_points[index++]);
-    for (size_t j = 1; j <= degree[1]; ++j, ++index) {
-      double ratio = (double)j / (degree[1] + 1);
-      tmp.push_back(control_points[index-1] * ratio +
-                    control_points[index] * (1 - ratio));
-    }
-    tmp.push_back(control_points[index-1]);
-  }
-  control_points = tmp;
-  degree[1]++;
+  TRACE_SCOPE("generateMesh");
+  Trace::counter("evaluations", resolution * resolution);
+  tessellate(patch, resolution, mesh, Precision::SINGLE);
 }
 
 void MyViewer::mouseMoveEvent(QMouseEvent *e) {
@@ -873,16 +950,30 @@ void MyViewer::mouseMoveEvent(QMouseEvent *e) {
     float d = (p - axes.grabbed_pos) * axis;
     axes.position[axes.selected_axis] = axes.original_pos[axes.selected_axis] + d;
   }
-
-  if (model_type == ModelType::MESH)
-    mesh.set_point(MyMesh::VertexHandle(selected_vertex),
-                   Vector(static_cast<double *>(axes.position)));
-  if (model_type == ModelType::BEZIER_SURFACE)
-    control_points[selected_vertex] = axes.position;
-  updateMesh();
+  axes.dragging = true;
+
+  if (model_type == ModelType::MESH) {
+    MyMesh::VertexHandle vh(selected_vertex);
+    mesh.set_point(vh, Vector(static_cast<double *>(axes.position)));
+    updateMeshLocally(vh);
+    if (!picking_dirty)
+      picking_index.update(selected_vertex, mesh.point(vh));
+  }
+  if (model_type == ModelType::BEZIER_SURFACE) {
+    patch.control_points[selected_vertex] = Vector(static_cast<double *>(axes.position));
+    updateMesh();
+  }
   update();
 }
 
+void MyViewer::mouseReleaseEvent(QMouseEvent *e) {
+  if (axes.dragging) {
+    axes.dragging = false;
+    update();                   // with the deferred updates
+  }
+  QGLViewer::mouseReleaseEvent(e);
+}
+
 QString MyViewer::helpString() const {
   QString text("<h2>Sample Framework</h2>"
                "<p>This is a minimal framework for 3D mesh manipulation, which can be "
@@ -891,29 +982,36 @@ QString MyViewer::helpString() const {
                "parametric surfaces, etc.</p>"
                "<p>The following hotkeys are available:</p>"
                "<ul>"
-               "<li>&nbsp;R: Reload model</li>"
+               "<li>&nbsp;R: Reload model (see also File / Watch file)</li>"
                "<li>&nbsp;O: Toggle orthographic projection</li>"
                "<li>&nbsp;P: Set plain map (no coloring)</li>"
-               "<li>&nbsp;M: Set mean curvature map</li>"
+               "<li>&nbsp;M: Set curvature map</li>"
+               "<li>&nbsp;Shift+M: Change curvature map field (mean, Gaussian, principal...)</li>"
+               "<li>&nbsp;K: Toggle curvature estimation (dihedral / Rusinkiewicz)</li>"
                "<li>&nbsp;L: Set slicing map<ul>"
                "<li>&nbsp;+: Increase slicing density</li>"
                "<li>&nbsp;-: Decrease slicing density</li>"
-               "<li>&nbsp;*: Set slicing direction to view</li></ul></li>"
+               "<li>&nbsp;*: Set slicing direction to view</li>"
+               "<li>&nbsp;Shift+L: Toggle contour lines</li></ul></li>"
                "<li>&nbsp;I: Set isophote line map</li>"
                "<li>&nbsp;E: Set environment texture</li>"
                "<li>&nbsp;C: Toggle control polygon visualization</li>"
                "<li>&nbsp;S: Toggle solid (filled polygon) visualization</li>"
                "<li>&nbsp;W: Toggle wireframe visualization</li>"
                "<li>&nbsp;F: Fair mesh</li>"
+               "<li>&nbsp;Shift+F: Fair mesh implicitly (bi-Laplacian)</li>"
                "<li>&nbsp;U: Elevate U degree (Bézier surface)</li>"
                "<li>&nbsp;V: Elevate V degree (Bézier surface)</li>"
                "<li>&nbsp;T: Change to trigonometric basis (only even degrees)</li>"
                "<li>&nbsp;B: Change to Bernstein basis</li>"
+               "<li>&nbsp;Shift+P: Fit Bézier surface to the point cloud</li>"
                "</ul>"
                "<p>There is also a simple selection and movement interface, enabled "
                "only when the wireframe/controlnet is displayed: a mesh vertex can be selected "
                "by shift-clicking, and it can be moved by shift-dragging one of the "
-               "displayed axes. Pressing ctrl enables movement in the screen plane.</p>"
+               "displayed axes. Pressing ctrl enables movement in the screen plane. "
+               "Shift-clicking elsewhere on a Bézier surface shows the parameters, "
+               "position and normal of the surface point.</p>"
                "<p>Note that libQGLViewer is furnished with a lot of useful features, "
                "such as storing/loading view positions, or saving screenshots. "
                "OpenMesh also has a nice collection of tools for mesh manipulation: "
@@ -4,11 +4,28 @@
 #include <string>
 
 #include <QGLViewer/qglviewer.h>
-#include <OpenMesh/Core/Mesh/TriMesh_ArrayKernelT.hh>
+#include <QtCore/QDateTime>
+#include <QtCore/QFileSystemWatcher>
+#include <QtCore/QTimer>
+#include <QtGui/QOpenGLFunctions_2_1>
+
+#include "contours.hh"
+#include "curvature.hh"
+#include "fairing.hh"
+#include "fitting.hh"
+#include "geometry.hh"
+#include "incremental-tessellation.hh"
+#include "mesh.hh"
+#include "MeshShader.h"
+#include "patch-intersection.hh"
+#include "patch-projection.hh"
+#include "point-index.hh"
+#include "statistics.hh"
+#include "tessellation-cache.hh"
 
 using qglviewer::Vec;
 
-class MyViewer : public QGLViewer {
+class MyViewer : public QGLViewer, protected QOpenGLFunctions_2_1 {
   Q_OBJECT
 
 public:
@@ -21,6 +38,8 @@ public:
   inline void setMeanMin(double min);
   inline double getMeanMax() const;
   inline void setMeanMax(double max);
+  inline const Statistics &getMeanStatistics() const;
+  void cutoffRange(double ratio, double &min, double &max) const;
   inline const double *getSlicingDir() const;
   inline void setSlicingDir(double x, double y, double z);
   inline double getSlicingScaling() const;
@@ -28,59 +47,70 @@ public:
   bool openMesh(const std::string &filename, bool update_view = true);
   bool openBezier(const std::string &filename, bool update_view = true);
   bool saveBezier(const std::string &filename);
+  bool openPointCloud(const std::string &filename);
+  bool saveContours(const std::string &filename);
+  bool exportMesh(const std::string &filename);
+  bool exportTessellation(const std::string &filename, size_t resolution);
+
+public slots:
+  void cancelComputation();
+  // Reloads the last opened file whenever it changes on disk
+  void setWatching(bool on);
 
 signals:
-  void startComputation(QString message);
+  void startComputation(QString message, bool cancellable = false);
   void midComputation(int percent);
   void endComputation();
 
 protected:
   virtual void init() override;
   virtual void draw() override;
-  virtual void drawWithNames() override;
+  virtual void select(const QPoint &point) override;
   virtual void postSelection(const QPoint &p) override;
   virtual void keyPressEvent(QKeyEvent *e) override;
   virtual void mouseMoveEvent(QMouseEvent *e) override;
+  virtual void mouseReleaseEvent(QMouseEvent *e) override;
   virtual QString helpString() const override;
 
-private:
-  struct MyTraits : public OpenMesh::DefaultTraits {
-    using Point  = OpenMesh::Vec3d; // the default would be Vec3f
-    using Normal = OpenMesh::Vec3d;
-    VertexTraits {
-      double mean;              // approximated mean curvature
-      double u, v;              // parameters (for Bezier surfaces)
-    };
-  };
-  using MyMesh = OpenMesh::TriMesh_ArrayKernelT<MyTraits>;
-  using Vector = OpenMesh::VectorT<double,3>;
+private slots:
+  void watchedFileChanged();
+  void watchedDirectoryChanged();
+  void reloadWatchedFile();
 
+private:
   // Mesh
-  void updateMesh(bool update_mean_range = true);
+  // With `cached`, Bezier tessellations are looked up in (and added to) the tessellation cache
+  void updateMesh(bool update_mean_range = true, bool cached = false);
+  void updateMeshLocally(MyMesh::VertexHandle moved);
   void updateVertexNormals();
-  void localSystem(const Vector &normal, Vector &u, Vector &v);
-  double voronoiWeight(MyMesh::HalfedgeHandle in_he);
-  void updateMeanMinMax();
-  void updateMeanCurvature(bool update_min_max = true);
+  void updateMeanStatistics();
+  void updateMeanRange();
+  void updateCurvature(bool update_min_max = true);
+  // Returns false when the patch needs a full update
+  bool updateMeshIncrementally(const Patch &new_patch);
 
   // Bezier
-  Vec evaluate(double u, double v, size_t derivatives,
-               std::vector<std::vector<Vec>> &der);
-  Vec evaluate(double u, double v);
   void generateMesh(size_t resolution);
-  void elevateU();
-  void elevateV();
+  void probe(const QPoint &point);
+  void projectPointCloud();
+  void fitToPointCloud();
 
   // Visualization
   void setupCamera();
-  Vec meanMapColor(double d) const;
-  void drawControlNet() const;
-  void drawAxes() const;
-  void drawAxesWithNames() const;
+  void updateBuffers();
+  void drawBuffers(bool attributes);
+  void drawControlNet();
+  void drawPointCloud();
+  void updateContours();
+  void drawContours();
+  void drawAxes();
+  void drawAxesWithNames();
+  int pick(const QPoint &point);
   static Vec intersectLines(const Vec &ap, const Vec &ad, const Vec &bp, const Vec &bd);
 
   // Other
   void fairMesh();
+  void fairMeshImplicit();
 
   //////////////////////
   // Member variables //
@@ -90,27 +120,64 @@ private:
 
   // Mesh
   MyMesh mesh;
+  MeshGeometry geometry;
+  CurvatureFields fields;
+  Fairing fairing;
+  CurvatureEstimator curvature_estimator;
 
   // Bezier
-  size_t degree[2];
-  std::vector<Vec> control_points;
-  bool trigonometric_basis;
+  Patch patch;
+  PatchIntersector intersector;
+  bool intersector_dirty;
+  TessellationCache tessellation_cache; // for patches opened from files
+  IncrementalTessellation incremental;  // for reloads with moved control points
+  bool incremental_dirty;               // the mesh was rebuilt since its last build
+
+  // Point cloud, compared to the Bezier surface
+  PatchProjector projector;
+  Fitting fitting;
+  static constexpr double FIT_SMOOTHING = 1.0e-4;
+  struct PointCloud {
+    std::vector<Vector> points;
+    std::vector<PatchProjector::Result> projections;
+    std::vector<GLfloat> colors;        // by signed deviation
+  } cloud;
+  bool cloud_dirty;             // projected onto an older patch (reprojected when drawn)
 
   // Visualization
   double mean_min, mean_max, cutoff_ratio;
-  bool show_control_points, show_solid, show_wireframe;
-  enum class Visualization { PLAIN, MEAN, SLICING, ISOPHOTES } visualization;
-  GLuint isophote_texture, environment_texture, current_isophote_texture, slicing_texture;
+  Statistics mean_statistics;   // of the displayed field
+  CurvatureFields::Field displayed_field;
+  bool show_control_points, show_solid, show_wireframe, show_contours;
+  using Visualization = MeshShader::Mode;
+  Visualization visualization;
+  bool environment_map;         // instead of the isophotes
+  MeshShader mesh_shader;
+  struct MeshBuffers {
+    GLuint vertices, attributes, indices;
+    GLsizei n_indices;
+    bool geometry_dirty, topology_dirty, attributes_dirty;
+    std::vector<MyMesh::VertexHandle> dirty_vertices; // changed since the last upload
+  } buffers;
   Vector slicing_dir;
   double slicing_scaling;
+  Contours contours;
+  bool contours_dirty;
   int selected_vertex;
+  PointIndex picking_index;     // over mesh vertices or control points
+  bool picking_dirty;
   struct ModificationAxes {
-    bool shown;
+    bool shown, dragging;
     float size;
     int selected_axis;
     Vec position, grabbed_pos, original_pos;
   } axes;
   std::string last_filename;
+  bool watching;
+  QFileSystemWatcher watcher;   // of last_filename and its directory, when watching
+  QDateTime watched_modified;   // of last_filename when last (re)loaded
+  QTimer reload_timer;          // waits for the writes of a save to settle
+  bool computation_cancelled;   // requested during a cancellable computation
 };
 
 #include "MyViewer.hpp"
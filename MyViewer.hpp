@@ -4,7 +4,7 @@ double MyViewer::getCutoffRatio() const {
 
 void MyViewer::setCutoffRatio(double ratio) {
   cutoff_ratio = ratio;
-  updateMeanMinMax();
+  updateMeanRange();
 }
 
 double MyViewer::getMeanMin() const {
@@ -23,12 +23,17 @@ void MyViewer::setMeanMax(double max) {
   mean_max = max;
 }
 
+const Statistics &MyViewer::getMeanStatistics() const {
+  return mean_statistics;
+}
+
 const double *MyViewer::getSlicingDir() const {
   return slicing_dir.data();
 }
 
 void MyViewer::setSlicingDir(double x, double y, double z) {
   slicing_dir = Vector(x, y, z).normalized();
+  contours_dirty = true;
 }
 
 double MyViewer::getSlicingScaling() const {
@@ -37,5 +42,6 @@ double MyViewer::getSlicingScaling() const {
 
 void MyViewer::setSlicingScaling(double scaling) {
   slicing_scaling = scaling;
+  contours_dirty = true;
 }
 
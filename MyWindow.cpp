@@ -1,8 +1,46 @@
+#include <algorithm>
+#include <cmath>
 #include <memory>
 
 #include <QtWidgets>
 
 #include "MyWindow.h"
+#include "trace.hh"
+
+namespace {
+
+  // Logarithmically scaled histogram of the mean curvature values, with the range [min, max] marked.
+  QPixmap histogramPixmap(const Statistics &stats, double min, double max) {
+    const int width = 256, height = 64;
+    QPixmap pixmap(width, height);
+    pixmap.fill(Qt::white);
+    if (stats.size() == 0)
+      return pixmap;
+
+    QPainter painter(&pixmap);
+    auto hist = stats.histogram(width);
+    double top = std::log1p(*std::max_element(hist.begin(), hist.end()));
+    painter.setPen(Qt::darkGray);
+    for (int i = 0; i < width; ++i)
+      painter.drawLine(i, height, i, height - (int)(std::log1p(hist[i]) / top * height));
+
+    double lo = stats.min(), hi = stats.max();
+    if (hi > lo) {
+      painter.setPen(Qt::red);
+      for (double x : { min, max }) {
+        int i = std::round((std::min(std::max(x, lo), hi) - lo) / (hi - lo) * (width - 1));
+        painter.drawLine(i, 0, i, height);
+      }
+    }
+    return pixmap;
+  }
+
+  QString statisticsText(const Statistics &stats, double min, double max) {
+    return QObject::tr("Values: [%1, %2], range: [%3, %4]")
+      .arg(stats.min()).arg(stats.max()).arg(min).arg(max);
+  }
+
+}
 
 MyWindow::MyWindow(QApplication *parent) :
   QMainWindow(), parent(parent), last_directory(".")
@@ -13,11 +51,16 @@ MyWindow::MyWindow(QApplication *parent) :
   progress->setMinimum(0); progress->setMaximum(100);
   progress->hide();
   statusBar()->addPermanentWidget(progress);
+  cancel = new QPushButton(tr("Cancel"));
+  cancel->hide();
+  statusBar()->addPermanentWidget(cancel);
 
   viewer = new MyViewer(this);
-  connect(viewer, SIGNAL(startComputation(QString)), this, SLOT(startComputation(QString)));
+  connect(viewer, SIGNAL(startComputation(QString, bool)),
+          this, SLOT(startComputation(QString, bool)));
   connect(viewer, SIGNAL(midComputation(int)), this, SLOT(midComputation(int)));
   connect(viewer, SIGNAL(endComputation()), this, SLOT(endComputation()));
+  connect(cancel, SIGNAL(pressed()), viewer, SLOT(cancelComputation()));
   setCentralWidget(viewer);
 
   /////////////////////////
@@ -29,10 +72,42 @@ MyWindow::MyWindow(QApplication *parent) :
   openAction->setStatusTip(tr("Load a model from a file"));
   connect(openAction, SIGNAL(triggered()), this, SLOT(open()));
 
+  auto cloudAction = new QAction(tr("Open &point cloud"), this);
+  cloudAction->setStatusTip(tr("Compare a point cloud to the Bézier surface"));
+  connect(cloudAction, SIGNAL(triggered()), this, SLOT(openPointCloud()));
+
   auto saveAction = new QAction(tr("&Save as.."), this);
   saveAction->setStatusTip(tr("Save a Bézier surface to a file"));
   connect(saveAction, SIGNAL(triggered()), this, SLOT(save()));
 
+  auto contoursAction = new QAction(tr("Export &contours.."), this);
+  contoursAction->setStatusTip(tr("Save the slicing contour lines to a file"));
+  connect(contoursAction, SIGNAL(triggered()), this, SLOT(saveContours()));
+
+  auto exportAction = new QAction(tr("Export &mesh.."), this);
+  exportAction->setStatusTip(tr("Save the mesh with its normals and curvature in binary format"));
+  connect(exportAction, SIGNAL(triggered()), this, SLOT(exportMesh()));
+
+  auto tessellationAction = new QAction(tr("Export t&essellation.."), this);
+  tessellationAction->setStatusTip(tr("Save a tessellation of the Bézier surface "
+                                      "at any resolution"));
+  connect(tessellationAction, SIGNAL(triggered()), this, SLOT(exportTessellation()));
+
+  auto watchAction = new QAction(tr("&Watch file"), this);
+  watchAction->setCheckable(true);
+  watchAction->setStatusTip(tr("Reload the opened file whenever it changes"));
+  connect(watchAction, SIGNAL(toggled(bool)), viewer, SLOT(setWatching(bool)));
+
+  auto recordTraceAction = new QAction(tr("&Record trace"), this);
+  recordTraceAction->setCheckable(true);
+  recordTraceAction->setChecked(Trace::enabled());
+  recordTraceAction->setStatusTip(tr("Record the timing of the processing stages"));
+  connect(recordTraceAction, SIGNAL(toggled(bool)), this, SLOT(recordTrace(bool)));
+
+  auto traceAction = new QAction(tr("Save &trace.."), this);
+  traceAction->setStatusTip(tr("Save the recorded timings in Chrome trace format"));
+  connect(traceAction, SIGNAL(triggered()), this, SLOT(saveTrace()));
+
   auto quitAction = new QAction(tr("&Quit"), this);
   quitAction->setShortcut(tr("Ctrl+Q"));
   quitAction->setStatusTip(tr("Quit the program"));
@@ -52,7 +127,16 @@ MyWindow::MyWindow(QApplication *parent) :
 
   auto fileMenu = menuBar()->addMenu(tr("&File"));
   fileMenu->addAction(openAction);
+  fileMenu->addAction(cloudAction);
   fileMenu->addAction(saveAction);
+  fileMenu->addAction(contoursAction);
+  fileMenu->addAction(exportAction);
+  fileMenu->addAction(tessellationAction);
+  fileMenu->addAction(watchAction);
+  fileMenu->addSeparator();
+  fileMenu->addAction(recordTraceAction);
+  fileMenu->addAction(traceAction);
+  fileMenu->addSeparator();
   fileMenu->addAction(quitAction);
 
   auto visMenu = menuBar()->addMenu(tr("&Visualization"));
@@ -67,16 +151,16 @@ MyWindow::~MyWindow() {
 void MyWindow::open() {
   auto filename =
     QFileDialog::getOpenFileName(this, tr("Open File"), last_directory,
-                                 tr("Readable files (*.obj *.ply *.stl *.bzr);;"
+                                 tr("Readable files (*.obj *.ply *.stl *.bzr *.bzb);;"
                                     "Mesh (*.obj *.ply *.stl);;"
-                                    "Bézier surface (*.bzr);;"
+                                    "Bézier surface (*.bzr *.bzb);;"
                                     "All files (*.*)"));
   if(filename.isEmpty())
     return;
   last_directory = QFileInfo(filename).absolutePath();
 
   bool ok;
-  if (filename.endsWith(".bzr"))
+  if (filename.endsWith(".bzr") || filename.endsWith(".bzb"))
     ok = viewer->openBezier(filename.toUtf8().data());
   else
     ok = viewer->openMesh(filename.toUtf8().data());
@@ -86,10 +170,26 @@ void MyWindow::open() {
                          tr("Could not open file: ") + filename + ".");
 }
 
+void MyWindow::openPointCloud() {
+  auto filename =
+    QFileDialog::getOpenFileName(this, tr("Open Point Cloud"), last_directory,
+                                 tr("Mesh (*.obj *.ply *.stl *.off);;"
+                                    "All files (*.*)"));
+  if(filename.isEmpty())
+    return;
+  last_directory = QFileInfo(filename).absolutePath();
+
+  if (!viewer->openPointCloud(filename.toUtf8().data()))
+    QMessageBox::warning(this, tr("Cannot open file"),
+                         tr("Could not open point cloud (a Bézier surface is needed): ") +
+                         filename + ".");
+}
+
 void MyWindow::save() {
   auto filename =
     QFileDialog::getSaveFileName(this, tr("Save File"), last_directory,
-                                 tr("Bézier surface (*.bzr);;"));
+                                 tr("Bézier surface (*.bzr);;"
+                                    "Bézier surface, binary (*.bzb);;"));
   if(filename.isEmpty())
     return;
   last_directory = QFileInfo(filename).absolutePath();
@@ -99,6 +199,72 @@ void MyWindow::save() {
                          tr("Could not save file: ") + filename + ".");
 }
 
+void MyWindow::saveContours() {
+  auto filename =
+    QFileDialog::getSaveFileName(this, tr("Export Contours"), last_directory,
+                                 tr("Wavefront OBJ (*.obj);;"));
+  if(filename.isEmpty())
+    return;
+  last_directory = QFileInfo(filename).absolutePath();
+
+  if (!viewer->saveContours(filename.toUtf8().data()))
+    QMessageBox::warning(this, tr("Cannot save file"),
+                         tr("Could not save file: ") + filename + ".");
+}
+
+void MyWindow::exportMesh() {
+  auto filename =
+    QFileDialog::getSaveFileName(this, tr("Export Mesh"), last_directory,
+                                 tr("Binary PLY (*.ply);;"
+                                    "Binary glTF (*.glb);;"));
+  if(filename.isEmpty())
+    return;
+  last_directory = QFileInfo(filename).absolutePath();
+
+  if (!viewer->exportMesh(filename.toUtf8().data()))
+    QMessageBox::warning(this, tr("Cannot save file"),
+                         tr("Could not save file: ") + filename + ".");
+}
+
+void MyWindow::exportTessellation() {
+  bool ok;
+  int resolution = QInputDialog::getInt(this, tr("Export Tessellation"),
+                                        tr("Resolution (vertices per side):"),
+                                        1000, 2, 1000000, 1, &ok);
+  if (!ok)
+    return;
+  auto filename =
+    QFileDialog::getSaveFileName(this, tr("Export Tessellation"), last_directory,
+                                 tr("Binary PLY (*.ply);;"
+                                    "Binary glTF (*.glb);;"));
+  if(filename.isEmpty())
+    return;
+  last_directory = QFileInfo(filename).absolutePath();
+
+  if (!viewer->exportTessellation(filename.toUtf8().data(), resolution))
+    QMessageBox::warning(this, tr("Cannot save file"),
+                         tr("Could not save file: ") + filename + ".");
+}
+
+void MyWindow::recordTrace(bool on) {
+  if (on)
+    Trace::clear();
+  Trace::enable(on);
+}
+
+void MyWindow::saveTrace() {
+  auto filename =
+    QFileDialog::getSaveFileName(this, tr("Save Trace"), last_directory,
+                                 tr("Chrome trace (*.json);;"));
+  if(filename.isEmpty())
+    return;
+  last_directory = QFileInfo(filename).absolutePath();
+
+  if (!Trace::save(filename.toUtf8().data()))
+    QMessageBox::warning(this, tr("Cannot save file"),
+                         tr("Could not save file: ") + filename + ".");
+}
+
 void MyWindow::setCutoff() {
   // Memory management options for the dialog:
   // - on the stack (deleted at the end of the function)
@@ -113,6 +279,8 @@ void MyWindow::setCutoff() {
   auto *vb     = new QVBoxLayout;
   auto *text   = new QLabel(tr("Cutoff ratio:"));
   auto *sb     = new QDoubleSpinBox;
+  auto *info   = new QLabel;
+  auto *hist   = new QLabel;
   auto *cancel = new QPushButton(tr("Cancel"));
   auto *ok     = new QPushButton(tr("Ok"));
 
@@ -124,11 +292,24 @@ void MyWindow::setCutoff() {
   connect(ok,     SIGNAL(pressed()), dlg.get(), SLOT(accept()));
   ok->setDefault(true);
 
+  // Preview the resulting range on the histogram
+  const auto &stats = viewer->getMeanStatistics();
+  auto preview = [=, &stats](double ratio) {
+    double min, max;
+    viewer->cutoffRange(ratio, min, max);
+    info->setText(statisticsText(stats, min, max));
+    hist->setPixmap(histogramPixmap(stats, min, max));
+  };
+  preview(sb->value());
+  connect(sb, static_cast<void (QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged), preview);
+
   hb1->addWidget(text);
   hb1->addWidget(sb);
   hb2->addWidget(cancel);
   hb2->addWidget(ok);
   vb->addLayout(hb1);
+  vb->addWidget(hist);
+  vb->addWidget(info);
   vb->addLayout(hb2);
 
   dlg->setWindowTitle(tr("Set ratio"));
@@ -147,6 +328,8 @@ void MyWindow::setRange() {
        *text2  = new QLabel(tr("Max:"));
   auto *sb1    = new QDoubleSpinBox,
        *sb2    = new QDoubleSpinBox;
+  auto *info   = new QLabel;
+  auto *hist   = new QLabel;
   auto *cancel = new QPushButton(tr("Cancel"));
   auto *ok     = new QPushButton(tr("Ok"));
 
@@ -161,12 +344,23 @@ void MyWindow::setRange() {
   connect(ok,     SIGNAL(pressed()), &dlg, SLOT(accept()));
   ok->setDefault(true);
 
+  const auto &stats = viewer->getMeanStatistics();
+  auto preview = [=, &stats]() {
+    info->setText(statisticsText(stats, sb1->value(), sb2->value()));
+    hist->setPixmap(histogramPixmap(stats, sb1->value(), sb2->value()));
+  };
+  preview();
+  connect(sb1, static_cast<void (QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged), preview);
+  connect(sb2, static_cast<void (QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged), preview);
+
   grid->addWidget( text1, 1, 1, Qt::AlignRight);
   grid->addWidget(   sb1, 1, 2);
   grid->addWidget( text2, 2, 1, Qt::AlignRight);
   grid->addWidget(   sb2, 2, 2);
-  grid->addWidget(cancel, 3, 1);
-  grid->addWidget(    ok, 3, 2);
+  grid->addWidget(  hist, 3, 1, 1, 2);
+  grid->addWidget(  info, 4, 1, 1, 2);
+  grid->addWidget(cancel, 5, 1);
+  grid->addWidget(    ok, 5, 2);
 
   dlg.setWindowTitle(tr("Set range"));
   dlg.setLayout(grid);
@@ -226,19 +420,29 @@ void MyWindow::setSlicing() {
   }
 }
 
-void MyWindow::startComputation(QString message) {
+void MyWindow::startComputation(QString message, bool cancellable) {
   statusBar()->showMessage(message);
   progress->setValue(0);
   progress->show();
+  if (cancellable) {
+    // User input is processed (for the cancel button), so everything else is disabled
+    menuBar()->setEnabled(false);
+    viewer->setEnabled(false);
+    cancel->show();
+  }
   parent->processEvents(QEventLoop::ExcludeUserInputEvents);
 }
 
 void MyWindow::midComputation(int percent) {
   progress->setValue(percent);
-  parent->processEvents(QEventLoop::ExcludeUserInputEvents);
+  parent->processEvents(cancel->isVisible() ? QEventLoop::AllEvents
+                                            : QEventLoop::ExcludeUserInputEvents);
 }
 
 void MyWindow::endComputation() {
   progress->hide();
+  cancel->hide();
+  menuBar()->setEnabled(true);
+  viewer->setEnabled(true);
   statusBar()->clearMessage();
 }
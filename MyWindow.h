@@ -7,6 +7,7 @@
 
 class QApplication;
 class QProgressBar;
+class QPushButton;
 
 class MyWindow : public QMainWindow {
   Q_OBJECT
@@ -17,11 +18,17 @@ public:
 
 private slots:
   void open();
+  void openPointCloud();
   void save();
+  void saveContours();
+  void exportMesh();
+  void exportTessellation();
+  void recordTrace(bool on);
+  void saveTrace();
   void setCutoff();
   void setRange();
   void setSlicing();
-  void startComputation(QString message);
+  void startComputation(QString message, bool cancellable);
   void midComputation(int percent);
   void endComputation();
 
@@ -29,5 +36,6 @@ private:
   QApplication *parent;
   MyViewer *viewer;
   QProgressBar *progress;
+  QPushButton *cancel;
   QString last_directory;
 };
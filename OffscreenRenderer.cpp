@@ -0,0 +1,445 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include <QtGui/QImage>
+#include <QtGui/QOffscreenSurface>
+#include <QtGui/QOpenGLContext>
+#include <QtGui/QOpenGLFramebufferObject>
+
+#include <OpenMesh/Core/IO/MeshIO.hh>
+
+#include "mesh-loader.hh"
+#include "patch-file.hh"
+#include "statistics.hh"
+#include "tessellation.hh"
+
+#include "OffscreenRenderer.h"
+
+using OffscreenRenderer::Job;
+
+namespace {
+
+  // read_mesh uses a global reader registry
+  std::mutex openmesh_mutex;
+  std::mutex error_mutex;
+
+  void reportError(const Job &job, const std::string &message) {
+    std::lock_guard<std::mutex> lock(error_mutex);
+    std::cerr << job.model << ": " << message << std::endl;
+  }
+
+  bool hasExtension(const std::string &filename, const std::string &ext) {
+    auto dot = filename.find_last_of('.');
+    return dot != std::string::npos && filename.substr(dot + 1) == ext;
+  }
+
+  // The model with the displayed field and range, prepared as in MyViewer::updateMesh
+  struct Scene {
+    MyMesh mesh;
+    CurvatureFields fields;
+    double min, max;
+    Vector box_min, box_max;
+  };
+
+  bool prepare(const Job &job, TessellationCache *cache, Scene &scene) {
+    auto &mesh = scene.mesh;
+    bool bezier = PatchFile::isBinary(job.model) || hasExtension(job.model, "bzr");
+    Patch patch;
+    bool cached = false;
+    if (bezier) {
+      bool ok = PatchFile::isBinary(job.model) ? PatchFile::read(job.model, patch)
+                                               : PatchFile::readText(job.model, patch);
+      if (!ok || job.resolution < 2) {
+        reportError(job, "cannot read the patch");
+        return false;
+      }
+      if (cache && cache->load(patch, job.resolution, Precision::DOUBLE, mesh, scene.fields))
+        cached = true;
+      else
+        tessellate(patch, job.resolution, mesh);
+    } else {
+      auto result = MeshLoader::load(job.model, mesh, [](int) { return true; });
+      if (result == MeshLoader::Result::UNSUPPORTED) {
+        std::lock_guard<std::mutex> lock(openmesh_mutex);
+        if (!OpenMesh::IO::read_mesh(mesh, job.model))
+          result = MeshLoader::Result::ERROR;
+      }
+      if (result == MeshLoader::Result::ERROR || mesh.n_vertices() == 0) {
+        reportError(job, "cannot read the mesh");
+        return false;
+      }
+    }
+
+    mesh.request_face_normals(); mesh.request_vertex_normals();
+    mesh.update_face_normals();
+    if (bezier && !cached) {
+      patchNormals(patch, mesh);
+      patchCurvatures(mesh, patch, scene.fields);
+      if (cache)
+        cache->store(patch, job.resolution, Precision::DOUBLE, mesh, scene.fields);
+    } else if (!bezier) {
+      MeshGeometry geometry;
+      geometry.update(mesh);
+      int nv = mesh.n_vertices();
+#pragma omp parallel for
+      for (int i = 0; i < nv; ++i) {
+        MyMesh::VertexHandle v(i);
+        mesh.set_normal(v, vertexNormal(mesh, geometry, v));
+      }
+      if (job.estimator == CurvatureEstimator::RUSINKIEWICZ)
+        principalCurvatures(mesh, geometry, scene.fields);
+      else
+        dihedralCurvatures(mesh, geometry, scene.fields);
+    }
+
+    scene.box_min = scene.box_max = mesh.point(*mesh.vertices_begin());
+    for (auto v : mesh.vertices()) {
+      scene.box_min.minimize(mesh.point(v));
+      scene.box_max.maximize(mesh.point(v));
+    }
+
+    // As MyViewer::cutoffRange
+    scene.min = job.min;
+    scene.max = job.max;
+    if (scene.min == scene.max) {
+      Statistics statistics;
+      statistics.build(scene.fields.values[job.field]);
+      size_t n = statistics.size();
+      if (n > 0) {
+        size_t k = (double)n * job.cutoff_ratio;
+        scene.min = std::min(statistics.nth(k ? k-1 : 0), 0.0);
+        scene.max = std::max(statistics.nth(n-k), 0.0);
+      }
+    }
+    return true;
+  }
+
+  // Column-major matrices for glLoadMatrixd
+  void frustumMatrix(double fovy, double aspect, double z_near, double z_far, GLdouble *m) {
+    double f = 1.0 / std::tan(fovy / 2);
+    std::fill(m, m + 16, 0.0);
+    m[0] = f / aspect;
+    m[5] = f;
+    m[10] = (z_far + z_near) / (z_near - z_far);
+    m[11] = -1.0;
+    m[14] = 2 * z_far * z_near / (z_near - z_far);
+  }
+
+  void lookAtMatrix(const Vector &eye, const Vector &view, const Vector &up, GLdouble *m) {
+    Vector z = -view.normalized();
+    Vector x = (up % z);
+    if (x.length() < 1e-10)     // up is parallel to the view direction
+      x = Vector(z[1], -z[0], 0).length() > 1e-10 ? Vector(z[1], -z[0], 0) : Vector(1, 0, 0);
+    x.normalize();
+    Vector y = z % x;
+    std::fill(m, m + 16, 0.0);
+    for (size_t i = 0; i < 3; ++i) {
+      m[4*i+0] = x[i];
+      m[4*i+1] = y[i];
+      m[4*i+2] = z[i];
+    }
+    m[12] = -(x | eye);
+    m[13] = -(y | eye);
+    m[14] = -(z | eye);
+    m[15] = 1.0;
+  }
+
+  // The GL resources of a thread, with its context current
+  class Worker : protected QOpenGLFunctions_2_1 {
+  public:
+    bool init();
+    void destroy();
+    bool render(const Job &job, const Scene &scene, QImage &image);
+
+  private:
+    MeshShader shader;
+    GLuint buffers[3];          // vertices, attributes, indices
+    std::unique_ptr<QOpenGLFramebufferObject> fbo;
+  };
+
+  bool Worker::init() {
+    initializeOpenGLFunctions();
+    glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, 1);
+    glGenBuffers(3, buffers);
+    return shader.init();
+  }
+
+  void Worker::destroy() {
+    fbo.reset();
+    shader.destroy();
+    glDeleteBuffers(3, buffers);
+  }
+
+  bool Worker::render(const Job &job, const Scene &scene, QImage &image) {
+    const auto &mesh = scene.mesh;
+    if (!fbo || fbo->width() != job.width || fbo->height() != job.height) {
+      fbo.reset(new QOpenGLFramebufferObject(job.width, job.height,
+                                             QOpenGLFramebufferObject::Depth));
+      if (!fbo->isValid()) {
+        fbo.reset();
+        return false;
+      }
+    }
+    fbo->bind();
+
+    // Same buffers as MyViewer::updateBuffers
+    std::vector<GLfloat> data(mesh.n_vertices() * 6);
+    for (auto v : mesh.vertices()) {
+      const auto &p = mesh.point(v);
+      const auto &n = mesh.normal(v);
+      GLfloat *d = &data[v.idx() * 6];
+      d[0] = p[0]; d[1] = p[1]; d[2] = p[2];
+      d[3] = n[0]; d[4] = n[1]; d[5] = n[2];
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(GLfloat), data.data(), GL_STATIC_DRAW);
+    const auto &values = scene.fields.values[job.field];
+    std::vector<GLfloat> attributes(values.begin(), values.end());
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+    glBufferData(GL_ARRAY_BUFFER, attributes.size() * sizeof(GLfloat), attributes.data(),
+                 GL_STATIC_DRAW);
+    std::vector<GLuint> indices;
+    indices.reserve(mesh.n_faces() * 3);
+    for (auto f : mesh.faces())
+      for (auto v : mesh.fv_range(f))
+        indices.push_back(v.idx());
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(),
+                 GL_STATIC_DRAW);
+
+    // The camera of showEntireScene: the bounding sphere fits in the field of view
+    double fovy = M_PI / 4, aspect = (double)job.width / job.height;
+    double fov = std::min(fovy, 2 * std::atan(std::tan(fovy / 2) * aspect));
+    Vector center = (scene.box_min + scene.box_max) / 2;
+    double radius = std::max((scene.box_max - scene.box_min).length() / 2, 1e-10);
+    double distance = radius / std::sin(fov / 2);
+    GLdouble projection[16], modelview[16];
+    frustumMatrix(fovy, aspect, std::max(distance - radius, radius * 1e-3),
+                  distance + radius, projection);
+    lookAtMatrix(center - job.view.normalized() * distance, job.view, job.up, modelview);
+
+    glViewport(0, 0, job.width, job.height);
+    glClearColor(0.2f, 0.2f, 0.2f, 1.0f); // the background of QGLViewer
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_LIGHTING);
+    glEnable(GL_LIGHT0);
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixd(projection);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadMatrixd(modelview);
+
+    double density = job.density > 0 ? job.density : 20 / (scene.box_max - scene.box_min).max();
+    shader.bind(job.mode, job.environment, scene.min, scene.max, job.slicing * density);
+
+    // As MyViewer::drawBuffers
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 6 * sizeof(GLfloat), nullptr);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glNormalPointer(GL_FLOAT, 6 * sizeof(GLfloat), reinterpret_cast<void *>(3 * sizeof(GLfloat)));
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+    glEnableVertexAttribArray(MeshShader::CURVATURE_ATTRIBUTE);
+    glVertexAttribPointer(MeshShader::CURVATURE_ATTRIBUTE, 1, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, nullptr);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableVertexAttribArray(MeshShader::CURVATURE_ATTRIBUTE);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    shader.release();
+    fbo->release();
+    image = fbo->toImage();
+    return true;
+  }
+
+  // Takes jobs from the queue until it is empty
+  void work(QOffscreenSurface *surface, const std::vector<Job> &jobs, TessellationCache *cache,
+            std::atomic<size_t> &next, std::atomic<size_t> &failed) {
+    QOpenGLContext context;
+    context.setFormat(surface->requestedFormat());
+    Worker worker;
+    bool ok = context.create() && context.makeCurrent(surface) && worker.init();
+    for (size_t i = next++; i < jobs.size(); i = next++) {
+      const auto &job = jobs[i];
+      if (!ok) {
+        reportError(job, "cannot create an OpenGL context");
+        ++failed;
+        continue;
+      }
+      Scene scene;
+      QImage image;
+      if (!prepare(job, cache, scene)) {
+        ++failed;
+        continue;
+      }
+      if (!worker.render(job, scene, image)) {
+        reportError(job, "cannot create a framebuffer");
+        ++failed;
+        continue;
+      }
+      if (!image.save(QString::fromStdString(job.output), "PNG")) {
+        reportError(job, "cannot save " + job.output);
+        ++failed;
+      }
+    }
+    if (context.isValid() && QOpenGLContext::currentContext() == &context) {
+      worker.destroy();
+      context.doneCurrent();
+    }
+  }
+
+  bool parseVector(const std::string &s, size_t n, double *x) {
+    std::istringstream is(s);
+    is.imbue(std::locale::classic());
+    for (size_t i = 0; i < n; ++i) {
+      char separator;
+      if ((i > 0 && (!(is >> separator) || separator != ',')) || !(is >> x[i]))
+        return false;
+    }
+    return is.peek() == std::istringstream::traits_type::eof();
+  }
+
+  bool parseOption(const std::string &key, const std::string &value, Job &job) {
+    double x[3];
+    if (key == "mode") {
+      static const std::pair<const char *, MeshShader::Mode> modes[] = {
+        { "plain", MeshShader::Mode::PLAIN }, { "mean", MeshShader::Mode::MEAN },
+        { "slicing", MeshShader::Mode::SLICING }, { "isophotes", MeshShader::Mode::ISOPHOTES },
+        { "environment", MeshShader::Mode::ISOPHOTES }
+      };
+      for (const auto &m : modes)
+        if (value == m.first) {
+          job.mode = m.second;
+          job.environment = value == "environment";
+          return true;
+        }
+      return false;
+    }
+    if (key == "field") {
+      static const char *fields[] = { "mean", "gaussian", "min", "max",
+                                      "E", "F", "G", "L", "M", "N" };
+      for (int i = 0; i < CurvatureFields::N_FIELDS; ++i)
+        if (value == fields[i]) {
+          job.field = static_cast<CurvatureFields::Field>(i);
+          return true;
+        }
+      return false;
+    }
+    if (key == "estimator") {
+      if (value == "dihedral")
+        job.estimator = CurvatureEstimator::DIHEDRAL;
+      else if (value == "rusinkiewicz")
+        job.estimator = CurvatureEstimator::RUSINKIEWICZ;
+      else
+        return false;
+      return true;
+    }
+    if (key == "range") {
+      if (!parseVector(value, 2, x) || x[0] > x[1])
+        return false;
+      job.min = x[0];
+      job.max = x[1];
+      return true;
+    }
+    if (key == "view" || key == "up" || key == "slicing") {
+      if (!parseVector(value, 3, x) || Vector(x[0], x[1], x[2]).length() == 0)
+        return false;
+      (key == "view" ? job.view : key == "up" ? job.up : job.slicing) = Vector(x[0], x[1], x[2]);
+      if (key == "slicing")
+        job.slicing.normalize();
+      return true;
+    }
+    if (key == "cutoff" || key == "density") {
+      if (!parseVector(value, 1, x) || x[0] < 0)
+        return false;
+      (key == "cutoff" ? job.cutoff_ratio : job.density) = x[0];
+      return true;
+    }
+    if (key == "resolution") {
+      if (!parseVector(value, 1, x) || x[0] < 2)
+        return false;
+      job.resolution = x[0];
+      return true;
+    }
+    if (key == "size") {
+      std::istringstream is(value);
+      char separator;
+      return is >> job.width >> separator >> job.height && separator == 'x' &&
+        job.width > 0 && job.height > 0 && is.peek() == std::istringstream::traits_type::eof();
+    }
+    return false;
+  }
+
+}
+
+namespace OffscreenRenderer {
+
+  bool readJobs(const std::string &filename, std::vector<Job> &jobs) {
+    std::ifstream f(filename.c_str());
+    if (!f.is_open()) {
+      std::cerr << "Cannot open " << filename << std::endl;
+      return false;
+    }
+    std::string line;
+    for (size_t line_number = 1; std::getline(f, line); ++line_number) {
+      std::istringstream is(line);
+      Job job;
+      if (!(is >> job.model) || job.model[0] == '#')
+        continue;
+      if (!(is >> job.output)) {
+        std::cerr << filename << ":" << line_number << ": missing output" << std::endl;
+        return false;
+      }
+      std::string option;
+      while (is >> option) {
+        auto eq = option.find('=');
+        if (eq == std::string::npos ||
+            !parseOption(option.substr(0, eq), option.substr(eq + 1), job)) {
+          std::cerr << filename << ":" << line_number << ": invalid option " << option
+                    << std::endl;
+          return false;
+        }
+      }
+      jobs.push_back(job);
+    }
+    return true;
+  }
+
+  size_t render(const std::vector<Job> &jobs, size_t threads, TessellationCache *cache) {
+    if (threads == 0)
+      threads = std::max(std::thread::hardware_concurrency(), 1u);
+    if (!QOpenGLContext::supportsThreadedOpenGL())
+      threads = 1;
+    threads = std::max<size_t>(std::min(threads, jobs.size()), 1);
+
+    // Surfaces can only be created on the GUI thread
+    std::vector<std::unique_ptr<QOffscreenSurface>> surfaces;
+    for (size_t i = 0; i < threads; ++i) {
+      surfaces.emplace_back(new QOffscreenSurface);
+      surfaces.back()->create();
+    }
+
+    std::atomic<size_t> next(0), failed(0);
+    if (threads == 1)
+      work(surfaces[0].get(), jobs, cache, next, failed);
+    else {
+      std::vector<std::thread> pool;
+      for (size_t i = 0; i < threads; ++i)
+        pool.emplace_back(work, surfaces[i].get(), std::cref(jobs), cache, std::ref(next),
+                          std::ref(failed));
+      for (auto &t : pool)
+        t.join();
+    }
+    return failed;
+  }
+
+}
@@ -0,0 +1,50 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "curvature.hh"
+#include "mesh.hh"
+#include "MeshShader.h"
+#include "tessellation-cache.hh"
+
+// Snapshots of the visualizations without a window, for batch processing.
+// Each job loads a model (mesh, .bzr or .bzb), computes its normals and curvature as the viewer
+// does, renders it into a framebuffer object and saves it as PNG.
+// The jobs are taken from a shared queue by a pool of threads, each with its own OpenGL context
+// (when the platform cannot render from several threads, they run on the calling thread).
+namespace OffscreenRenderer {
+
+  struct Job {
+    std::string model, output;
+    MeshShader::Mode mode = MeshShader::Mode::MEAN;
+    bool environment = false;   // the environment map instead of the isophotes
+    CurvatureFields::Field field = CurvatureFields::MEAN;
+    CurvatureEstimator estimator = CurvatureEstimator::DIHEDRAL; // for meshes
+    double min = 0.0, max = 0.0;  // range of the field; when equal, set by the cutoff ratio
+    double cutoff_ratio = 0.05;
+    Vector view = Vector(0, 0, -1), up = Vector(0, 1, 0); // the model fills the image
+    Vector slicing = Vector(0, 0, 1);
+    double density = 0.0;       // of the slicing stripes; 0: 20 stripes across the model
+    size_t resolution = 50;     // of Bezier surfaces
+    int width = 800, height = 600;
+  };
+
+  // One job per line, as `model output [key=value ...]`, with the keys
+  //   mode: plain, mean, slicing, isophotes or environment
+  //   field: mean, gaussian, min, max, E, F, G, L, M or N
+  //   estimator: dihedral or rusinkiewicz
+  //   range: min,max      cutoff: ratio
+  //   view, up, slicing: x,y,z      density: stripes per unit
+  //   resolution: vertices per side      size: widthxheight
+  // Empty lines and lines starting with # are skipped.
+  bool readJobs(const std::string &filename, std::vector<Job> &jobs);
+
+  // Runs the jobs on the given number of threads (0: one per core), and returns the number
+  // of failed jobs (reported on std::cerr). Must be called on the GUI thread.
+  // With a cache, the tessellations of Bezier surfaces are looked up there first.
+  size_t render(const std::vector<Job> &jobs, size_t threads = 0,
+                TessellationCache *cache = nullptr);
+
+}
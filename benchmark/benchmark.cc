@@ -0,0 +1,469 @@
+// Micro- and macro-benchmarks of the geometry pipeline, on procedurally generated input.
+//
+// Usage: benchmark [--output results.json] [--baseline old.json] [--tolerance 0.1]
+//                  [--filter substring] [--table ../trigo.tab] [--cache directory]
+//
+// Each benchmark is calibrated to about 50 ms per sample, and the median of the samples
+// is reported, in nanoseconds per run (items is the number of elements processed in a run).
+// The inputs use fixed seeds, so runs on the same machine are comparable.
+// With a baseline, benchmarks slower by more than the tolerance (as a ratio) are reported
+// as regressions, and the exit status is 1. The tessellation cache is only measured when
+// given an (existing) cache directory.
+// Independently of the filter, evaluation is checked not to allocate once warmed up
+// (see EvaluationWorkspace::allocations); if it does, the exit status is also 1.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "curvature.hh"
+#include "curve.hh"
+#include "fairing.hh"
+#include "geometry.hh"
+#include "incremental-tessellation.hh"
+#include "patch.hh"
+#include "patch-file.hh"
+#include "tessellation.hh"
+#include "tessellation-cache.hh"
+#include "trigo-basis.hh"
+
+namespace {
+
+  constexpr double SAMPLE_TIME = 0.05; // seconds
+  constexpr size_t SAMPLES = 5;
+
+  struct Result {
+    std::string name;
+    double ns;
+    size_t items, iterations;
+  };
+
+  std::vector<Result> results;
+  std::string filter;
+
+  // Times `body` (processing `items` elements per call)
+  template <typename F>
+  void run(const std::string &name, size_t items, F body) {
+    if (name.find(filter) == std::string::npos)
+      return;
+    using Clock = std::chrono::steady_clock;
+    auto time = [&](size_t iterations) {
+      auto start = Clock::now();
+      for (size_t i = 0; i < iterations; ++i)
+        body();
+      return std::chrono::duration<double>(Clock::now() - start).count();
+    };
+    double once = time(1);      // also a warm-up
+    size_t iterations = std::max<size_t>(1, SAMPLE_TIME / std::max(once, 1.0e-9));
+    std::vector<double> samples;
+    for (size_t i = 0; i < SAMPLES; ++i)
+      samples.push_back(time(iterations) / iterations * 1.0e9);
+    std::nth_element(samples.begin(), samples.begin() + SAMPLES / 2, samples.end());
+    results.push_back({ name, samples[SAMPLES/2], items, iterations });
+    std::cerr << name << ": " << samples[SAMPLES/2] << " ns" << std::endl;
+  }
+
+  std::string label(const std::string &base, const std::string &key, size_t value) {
+    return base + "/" + key + "=" + std::to_string(value);
+  }
+
+  // Gently waving surface with random bumps on the unit square
+  Patch proceduralPatch(size_t n, size_t m, bool trigonometric) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> bump(-0.1, 0.1);
+    Patch patch;
+    patch.degree[0] = n;
+    patch.degree[1] = m;
+    patch.trigonometric = trigonometric;
+    for (size_t i = 0; i <= n; ++i)
+      for (size_t j = 0; j <= m; ++j) {
+        double u = (double)i / n, v = (double)j / m;
+        patch.control_points.emplace_back(u, v, 0.2 * std::sin(3 * u) * std::cos(2 * v) + bump(rng));
+      }
+    return patch;
+  }
+
+  MyMesh proceduralMesh(size_t resolution) {
+    MyMesh mesh;
+    tessellate(proceduralPatch(5, 5, false), resolution, mesh);
+    mesh.request_face_normals();
+    mesh.request_vertex_normals();
+    mesh.update_face_normals();
+    return mesh;
+  }
+
+  // Prevents the optimizer from dropping the computation
+  volatile double sink;
+
+  void basisBenchmarks(bool table) {
+    std::vector<double> params(1000);
+    for (size_t i = 0; i < params.size(); ++i)
+      params[i] = (double)i / (params.size() - 1);
+    std::vector<std::vector<double>> coeffs;
+    for (size_t degree = 3; degree <= 21; ++degree)
+      for (size_t derivatives = 0; derivatives <= 2; ++derivatives) {
+        auto name = label(label("bernstein", "degree", degree), "derivatives", derivatives);
+        run(name, params.size(), [&]() {
+            for (double u : params) {
+              bernstein(degree, u, derivatives, coeffs);
+              sink = coeffs[0][0];
+            }
+          });
+        if (!table)
+          continue;
+        name = label(label("trigobasis", "degree", degree), "derivatives", derivatives);
+        run(name, params.size(), [&]() {
+            for (double u : params) {
+              trigobasis(degree, u, derivatives, coeffs);
+              sink = coeffs[0][0];
+            }
+          });
+      }
+  }
+
+  void evaluationBenchmarks(bool table) {
+    std::vector<std::pair<double, double>> params;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    for (size_t i = 0; i < 1000; ++i)
+      params.emplace_back(uniform(rng), uniform(rng));
+    for (bool trigonometric : { false, true }) {
+      if (trigonometric && !table)
+        continue;
+      for (size_t degree : { 4, 6, 10, 16 }) {
+        auto patch = proceduralPatch(degree, degree, trigonometric);
+        auto base = label(trigonometric ? "evaluate/trigonometric" : "evaluate/bezier",
+                          "degree", degree);
+        for (size_t derivatives = 0; derivatives <= 2; ++derivatives)
+          run(label(base, "derivatives", derivatives), params.size(), [&]() {
+              auto &der = EvaluationWorkspace::local().der;
+              for (const auto &p : params)
+                sink = patch.evaluate(p.first, p.second, derivatives, der)[0];
+            });
+      }
+    }
+  }
+
+  // Mixed evaluations of patches and curves of degrees 1-14 with 0-2 derivatives, after
+  // a warm-up with every combination; returns false if the workspace still had to grow
+  bool allocationCheck(bool table) {
+    std::vector<Patch> patches;
+    std::vector<Curve> curves;
+    for (bool trigonometric : { false, true }) {
+      if (trigonometric && !table)
+        continue;
+      for (size_t degree = trigonometric ? 2 : 1; degree <= 14; ++degree) {
+        patches.push_back(proceduralPatch(degree, degree, trigonometric));
+        Curve curve;
+        curve.degree = degree;
+        curve.trigonometric = trigonometric;
+        for (size_t i = 0; i <= degree; ++i)
+          curve.control_points.push_back(patches.back().control_points[i * (degree + 1)]);
+        curves.push_back(curve);
+      }
+    }
+    auto &workspace = EvaluationWorkspace::local();
+    auto evaluate = [&](size_t k, size_t derivatives, double u, double v) {
+      sink = patches[k].evaluate(u, v, derivatives, workspace.der)[0];
+      sink = patches[k].evaluate(u, v)[0];
+      sink = curves[k].evaluate(u, derivatives, workspace.curve)[0];
+      sink = curves[k].evaluate(v)[0];
+    };
+    for (size_t k = 0; k < patches.size(); ++k)
+      for (size_t derivatives = 0; derivatives <= 2; ++derivatives)
+        evaluate(k, derivatives, 0.5, 0.5);
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    size_t before = EvaluationWorkspace::allocations();
+    for (size_t i = 0; i < 10000; ++i) {
+      size_t k = rng() % patches.size(), derivatives = rng() % 3;
+      double u = uniform(rng), v = uniform(rng);
+      evaluate(k, derivatives, u, v);
+    }
+    size_t grown = EvaluationWorkspace::allocations() - before;
+    if (grown > 0)
+      std::cerr << "Steady-state evaluation allocated " << grown << " times" << std::endl;
+    return grown == 0;
+  }
+
+  // Batched evaluation and constant-speed sampling (as for toolpaths)
+  void curveBenchmarks(bool table) {
+    std::vector<double> params(1000);
+    for (size_t i = 0; i < params.size(); ++i)
+      params[i] = (double)i / (params.size() - 1);
+    for (bool trigonometric : { false, true }) {
+      if (trigonometric && !table)
+        continue;
+      for (size_t degree : { 3, 10 }) {
+        auto patch = proceduralPatch(degree, 1, trigonometric);
+        Curve curve;
+        curve.degree = degree;
+        curve.trigonometric = trigonometric;
+        for (size_t i = 0; i <= degree; ++i)
+          curve.control_points.push_back(patch.control_points[2*i]);
+        auto base = label(trigonometric ? "curve/trigonometric" : "curve/bezier",
+                          "degree", degree);
+        std::vector<std::vector<Vector>> der;
+        run(label(base + "/evaluate", "derivatives", 1), params.size(), [&]() {
+            curve.evaluate(params, 1, der);
+            sink = der[1][0][0];
+          });
+        ArcLength arc_length;
+        run(base + "/arc-length", 1, [&]() { arc_length.build(curve); });
+        std::vector<double> u;
+        run(base + "/sample", params.size(), [&]() {
+            arc_length.sample(params.size(), u);
+            sink = u[1];
+          });
+      }
+    }
+  }
+
+  void tessellationBenchmarks() {
+    auto patch = proceduralPatch(5, 5, false);
+    for (size_t resolution : { 50, 100, 200, 400 }) {
+      std::vector<Vector> points;
+      run(label("grid/single", "resolution", resolution), resolution * resolution,
+          [&]() { patch.evaluateGrid<float>(resolution, points); });
+      run(label("grid/double", "resolution", resolution), resolution * resolution,
+          [&]() { patch.evaluateGrid<double>(resolution, points); });
+      MyMesh mesh;
+      run(label("tessellate", "resolution", resolution), resolution * resolution,
+          [&]() { tessellate(patch, resolution, mesh, Precision::SINGLE); });
+      mesh.request_vertex_normals();
+      run(label("normals/patch", "resolution", resolution), resolution * resolution,
+          [&]() { patchNormals(patch, mesh); });
+    }
+  }
+
+  void meshBenchmarks() {
+    auto patch = proceduralPatch(5, 5, false);
+    for (size_t resolution : { 100, 200 }) {
+      auto mesh = proceduralMesh(resolution);
+      int nv = mesh.n_vertices();
+      MeshGeometry geometry;
+      CurvatureFields fields;
+      run(label("geometry", "resolution", resolution), nv, [&]() { geometry.update(mesh); });
+      run(label("normals/mesh", "resolution", resolution), nv, [&]() {
+#pragma omp parallel for
+          for (int i = 0; i < nv; ++i) {
+            MyMesh::VertexHandle v(i);
+            mesh.set_normal(v, vertexNormal(mesh, geometry, v));
+          }
+        });
+      run(label("curvature/dihedral", "resolution", resolution), nv,
+          [&]() { dihedralCurvatures(mesh, geometry, fields); });
+      run(label("curvature/rusinkiewicz", "resolution", resolution), nv,
+          [&]() { principalCurvatures(mesh, geometry, fields); });
+      run(label("curvature/patch", "resolution", resolution), nv,
+          [&]() { patchCurvatures(mesh, patch, fields); });
+    }
+    for (size_t resolution : { 50, 100 }) {
+      // Refairing the same topology only needs a back-substitution
+      auto mesh = proceduralMesh(resolution);
+      run(label("fairing/factorize", "resolution", resolution), mesh.n_vertices(), [&]() {
+          Fairing fairing;
+          fairing.fair(mesh);
+        });
+      Fairing fairing;
+      run(label("fairing/solve", "resolution", resolution), mesh.n_vertices(),
+          [&]() { fairing.fair(mesh); });
+    }
+  }
+
+  // Reloading a patch with one control point moved, from scratch and incrementally
+  void incrementalBenchmarks() {
+    auto patch = proceduralPatch(5, 5, false), moved = patch;
+    moved.control_points[14] += Vector(0, 0, 0.1);
+    for (size_t resolution : { 50, 200 }) {
+      MyMesh mesh;
+      CurvatureFields fields;
+      bool flip = false;
+      run(label("reload/full", "resolution", resolution), resolution * resolution, [&]() {
+          const auto &p = (flip = !flip) ? moved : patch;
+          tessellate(p, resolution, mesh);
+          mesh.request_vertex_normals();
+          patchNormals(p, mesh);
+          patchCurvatures(mesh, p, fields);
+        });
+      IncrementalTessellation incremental;
+      run(label("reload/incremental-build", "resolution", resolution), resolution * resolution,
+          [&]() { incremental.build(patch, resolution); });
+      tessellate(patch, resolution, mesh);
+      patchNormals(patch, mesh);
+      patchCurvatures(mesh, patch, fields);
+      std::vector<MyMesh::VertexHandle> changed;
+      flip = false;
+      run(label("reload/incremental", "resolution", resolution), resolution * resolution,
+          [&]() { incremental.update((flip = !flip) ? moved : patch, mesh, fields, changed); });
+    }
+  }
+
+  // Reading many small control nets (as batch jobs do), in the working directory
+  void ioBenchmarks() {
+    constexpr size_t COUNT = 100;
+    const std::string text = "benchmark-patch.bzr", binary = "benchmark-patches.bzb";
+    std::vector<Patch> patches(COUNT, proceduralPatch(5, 5, false));
+    if (!PatchFile::writeText(text, patches[0]) || !PatchFile::write(binary, patches)) {
+      std::cerr << "Cannot write to the working directory, skipping the I/O benchmarks"
+                << std::endl;
+      return;
+    }
+    Patch patch;
+    run("patch-io/text", COUNT, [&]() {
+        for (size_t i = 0; i < COUNT; ++i)
+          PatchFile::readText(text, patch);
+      });
+    run("patch-io/binary", COUNT, [&]() {
+        PatchFile::Reader reader;
+        reader.open(binary);
+        for (size_t i = 0; i < reader.size(); ++i)
+          reader.read(i, patch);
+      });
+    std::remove(text.c_str());
+    std::remove(binary.c_str());
+  }
+
+  // Reprocessing an unchanged patch, from scratch and from the tessellation cache
+  void cacheBenchmarks(const std::string &directory) {
+    TessellationCache cache;
+    if (!cache.open(directory)) {
+      std::cerr << "Cannot open " << directory << ", skipping the cache benchmarks" << std::endl;
+      return;
+    }
+    auto patch = proceduralPatch(5, 5, false);
+    MyMesh mesh;
+    CurvatureFields fields;
+    for (size_t resolution : { 50, 200 }) {
+      auto compute = [&]() {
+        tessellate(patch, resolution, mesh);
+        mesh.request_vertex_normals();
+        patchNormals(patch, mesh);
+        patchCurvatures(mesh, patch, fields);
+      };
+      run(label("tessellation-cache/miss", "resolution", resolution), resolution * resolution,
+          compute);
+      cache.store(patch, resolution, Precision::DOUBLE, mesh, fields);
+      run(label("tessellation-cache/hit", "resolution", resolution), resolution * resolution,
+          [&]() { cache.load(patch, resolution, Precision::DOUBLE, mesh, fields); });
+    }
+  }
+
+  bool save(const std::string &filename) {
+    try {
+      std::ofstream f(filename.c_str());
+      f.exceptions(std::ios::failbit | std::ios::badbit);
+      f.precision(10);
+      f << "{" << std::endl;
+      f << "  \"threads\": " << omp_get_max_threads() << "," << std::endl;
+      f << "  \"benchmarks\": [" << std::endl;
+      for (size_t i = 0; i < results.size(); ++i) {
+        const auto &r = results[i];
+        f << "    { \"name\": \"" << r.name << "\", \"ns\": " << r.ns
+          << ", \"items\": " << r.items << ", \"iterations\": " << r.iterations << " }"
+          << (i + 1 < results.size() ? "," : "") << std::endl;
+      }
+      f << "  ]" << std::endl << "}" << std::endl;
+    } catch(std::ofstream::failure &) {
+      return false;
+    }
+    return true;
+  }
+
+  // Reads the results of a previous run (as written by save)
+  bool loadBaseline(const std::string &filename, std::map<std::string, double> &baseline) {
+    std::ifstream f(filename.c_str());
+    if (!f)
+      return false;
+    std::regex entry("\"name\": \"([^\"]+)\", \"ns\": ([0-9.eE+-]+)");
+    std::string line;
+    std::smatch match;
+    while (std::getline(f, line))
+      if (std::regex_search(line, match, entry))
+        baseline[match[1]] = std::stod(match[2]);
+    return true;
+  }
+
+  // Returns the number of regressions
+  size_t compare(const std::map<std::string, double> &baseline, double tolerance) {
+    size_t regressions = 0;
+    for (const auto &r : results) {
+      auto it = baseline.find(r.name);
+      if (it == baseline.end())
+        continue;
+      double ratio = r.ns / it->second;
+      bool slower = ratio > 1.0 + tolerance;
+      if (slower)
+        regressions++;
+      std::cout << (slower ? "REGRESSION " : (ratio < 1.0 - tolerance ? "improved   " : "           "))
+                << r.name << ": " << it->second << " -> " << r.ns << " ns ("
+                << (ratio - 1.0) * 100 << "%)" << std::endl;
+    }
+    return regressions;
+  }
+
+}
+
+int main(int argc, char **argv) {
+  std::string output = "benchmark.json", baseline_file, table = "../trigo.tab", cache;
+  double tolerance = 0.1;
+  std::map<std::string, std::string *> options = {
+    { "--output", &output }, { "--baseline", &baseline_file }, { "--filter", &filter },
+    { "--table", &table }, { "--cache", &cache }
+  };
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool known = options.count(arg) || arg == "--tolerance";
+    if (!known || i + 1 == argc) {
+      std::cerr << (known ? "Missing value for " : "Unknown option: ") << arg << std::endl;
+      return 2;
+    }
+    if (arg == "--tolerance")
+      tolerance = std::stod(argv[++i]);
+    else
+      *options[arg] = argv[++i];
+  }
+
+  bool has_table = true;
+  try {
+    trigoinit(table);
+  } catch(std::ifstream::failure &) {
+    std::cerr << "Cannot read " << table << ", skipping the trigonometric benchmarks"
+              << std::endl;
+    has_table = false;
+  }
+
+  bool allocating = !allocationCheck(has_table);
+
+  basisBenchmarks(has_table);
+  evaluationBenchmarks(has_table);
+  curveBenchmarks(has_table);
+  tessellationBenchmarks();
+  meshBenchmarks();
+  incrementalBenchmarks();
+  ioBenchmarks();
+  if (!cache.empty())
+    cacheBenchmarks(cache);
+
+  if (!save(output)) {
+    std::cerr << "Cannot write " << output << std::endl;
+    return 2;
+  }
+  if (baseline_file.empty())
+    return allocating ? 1 : 0;
+  std::map<std::string, double> baseline;
+  if (!loadBaseline(baseline_file, baseline)) {
+    std::cerr << "Cannot read " << baseline_file << std::endl;
+    return 2;
+  }
+  return compare(baseline, tolerance) > 0 || allocating ? 1 : 0;
+}
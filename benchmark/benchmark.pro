@@ -0,0 +1,18 @@
+# -*- mode: Makefile -*-
+
+# Standalone benchmarks of the geometry pipeline (no Qt needed)
+TARGET = benchmark
+CONFIG += c++14 console release
+CONFIG -= qt app_bundle
+
+INCLUDEPATH += .. /usr/include/eigen3
+HEADERS = ../trigo-basis.hh ../mesh.hh ../geometry.hh ../curvature.hh ../fairing.hh \
+          ../bernstein.hh ../patch.hh ../tessellation.hh ../mapped-file.hh \
+          ../byte-order.hh ../patch-file.hh ../curve.hh ../tessellation-cache.hh \
+          ../incremental-tessellation.hh
+SOURCES = benchmark.cc ../trigo-basis.cc ../geometry.cc ../curvature.cc ../fairing.cc \
+          ../patch.cc ../tessellation.cc ../mapped-file.cc ../patch-file.cc \
+          ../curve.cc ../tessellation-cache.cc ../incremental-tessellation.cc
+
+QMAKE_CXXFLAGS += -fopenmp
+LIBS *= -L/usr/lib/OpenMesh -lOpenMeshCore -fopenmp
@@ -0,0 +1,79 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <cstddef>
+
+// Bernstein polynomials of degree N, with derivatives up to D, for a fixed degree,
+// so that all loop bounds are known at compile time (and the loops can be unrolled).
+// coeffs[d][i] is the d-th derivative of the i-th polynomial. T is the scalar type.
+template <size_t N, size_t D, typename T>
+void bernstein(T u, T (&coeffs)[D+1][N+1]) {
+  // Degree N - d is kept in coeffs[d] on the way up the triangular scheme
+  T *b = coeffs[0];
+  b[0] = 1;
+  T u1 = 1 - u;
+  for (size_t j = 1; j <= N; ++j) {
+    for (size_t d = 1; d <= D; ++d)
+      if (j - 1 == N - d)
+        for (size_t k = 0; k < j; ++k)
+          coeffs[d][k] = b[k];
+    T saved = 0;
+    for (size_t k = 0; k < j; ++k) {
+      T tmp = b[k];
+      b[k] = saved + tmp * u1;
+      saved = tmp * u;
+    }
+    b[j] = saved;
+  }
+
+  // Differentiate d times, by (B^m_i)' = m (B^(m-1)_(i-1) - B^(m-1)_i)
+  for (size_t d = 1; d <= D; ++d) {
+    T *a = coeffs[d];
+    if (d > N) {
+      for (size_t i = 0; i <= N; ++i)
+        a[i] = 0;
+      continue;
+    }
+    for (size_t m = N - d; m < N; ++m) {
+      a[m+1] = a[m] * (m + 1);
+      for (size_t i = m; i > 0; --i)
+        a[i] = (a[i-1] - a[i]) * (m + 1);
+      a[0] *= -(T)(m + 1);
+    }
+  }
+}
+
+// Tensor product Bezier patch of degrees (N, M), with derivatives up to D.
+// The control points are given as (N + 1) x (M + 1) consecutive (x, y, z) triplets,
+// with the v index varying fastest; der[i][j] (i + j <= D) is the derivative
+// i times by u and j times by v. T is the scalar type.
+template <size_t N, size_t M, size_t D, typename T>
+void bezierTensor(const T *points, T u, T v, T (&der)[D+1][D+1][3]) {
+  T cu[D+1][N+1], cv[D+1][M+1];
+  bernstein<N, D>(u, cu);
+  bernstein<M, D>(v, cv);
+  for (size_t i = 0; i <= D; ++i)
+    for (size_t j = 0; j <= D; ++j)
+      for (size_t c = 0; c < 3; ++c)
+        der[i][j][c] = 0;
+  for (size_t k = 0; k <= N; ++k) {
+    // Contract the k-th row with the v-basis first
+    const T *row_points = points + k * (M + 1) * 3;
+    T row[D+1][3];
+    for (size_t j = 0; j <= D; ++j) {
+      T x = 0, y = 0, z = 0;
+      for (size_t l = 0; l <= M; ++l) {
+        x += row_points[l*3] * cv[j][l];
+        y += row_points[l*3+1] * cv[j][l];
+        z += row_points[l*3+2] * cv[j][l];
+      }
+      row[j][0] = x; row[j][1] = y; row[j][2] = z;
+    }
+    for (size_t i = 0; i <= D; ++i)
+      for (size_t j = 0; i + j <= D; ++j) {
+        der[i][j][0] += row[j][0] * cu[i][k];
+        der[i][j][1] += row[j][1] * cu[i][k];
+        der[i][j][2] += row[j][2] * cu[i][k];
+      }
+  }
+}
@@ -0,0 +1,30 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// Helpers of the binary formats, which store values in a given (or the writer's) byte order.
+namespace ByteOrder {
+
+  inline bool littleEndianHost() {
+    uint16_t x = 1;
+    unsigned char c;
+    std::memcpy(&c, &x, 1);
+    return c == 1;
+  }
+
+  // Reads a value from possibly unaligned memory, reversing its bytes when `swap` is set.
+  template <typename T>
+  T load(const char *p, bool swap) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, p, sizeof(T));
+    if (swap)
+      std::reverse(bytes, bytes + sizeof(T));
+    T x;
+    std::memcpy(&x, bytes, sizeof(T));
+    return x;
+  }
+
+}
@@ -0,0 +1,206 @@
+#include "contours.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+void Contours::extract(const MyMesh &mesh, const Vector &new_dir, double new_scaling) {
+  dir = new_dir;
+  scaling = new_scaling;
+  int nv = mesh.n_vertices(), nf = mesh.n_faces();
+  heights.resize(nv);
+#pragma omp parallel for
+  for (int i = 0; i < nv; ++i)
+    heights[i] = (mesh.point(MyMesh::VertexHandle(i)) | dir) * scaling;
+
+  segments.assign(nf, {});
+#pragma omp parallel for
+  for (int i = 0; i < nf; ++i)
+    extractFace(mesh, MyMesh::FaceHandle(i));
+
+  faces.clear();
+  lines.clear();
+  if (nv == 0)
+    return;
+  auto range = std::minmax_element(heights.begin(), heights.end());
+  min_level = std::floor(*range.first);
+  faces.resize((int)std::floor(*range.second) - min_level + 1);
+  for (int i = 0; i < nf; ++i)
+    for (const auto &s : segments[i])
+      faces[s.level-min_level].push_back(i);
+
+  int n_levels = faces.size();
+  lines.resize(n_levels);
+#pragma omp parallel for schedule(dynamic)
+  for (int k = 0; k < n_levels; ++k)
+    chain(mesh, min_level + k);
+}
+
+void Contours::update(const MyMesh &mesh, const std::vector<MyMesh::VertexHandle> &moved) {
+  std::vector<int> changed;
+  for (auto v : moved) {
+    heights[v.idx()] = (mesh.point(v) | dir) * scaling;
+    for (auto f : mesh.vf_range(v))
+      changed.push_back(f.idx());
+  }
+  std::sort(changed.begin(), changed.end());
+  changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+
+  std::vector<int> levels;
+  for (int f : changed) {
+    for (const auto &s : segments[f])
+      levels.push_back(s.level);
+    extractFace(mesh, MyMesh::FaceHandle(f));
+    for (const auto &s : segments[f]) {
+      if (s.level < min_level || s.level >= min_level + (int)faces.size()) {
+        // Out of the current range of levels
+        extract(mesh, dir, scaling);
+        return;
+      }
+      levels.push_back(s.level);
+    }
+  }
+  std::sort(levels.begin(), levels.end());
+  levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+
+  // Update the face lists of the affected levels, then chain them again
+  for (int level : levels) {
+    auto &list = faces[level-min_level];
+    list.erase(std::remove_if(list.begin(), list.end(),
+                              [&](int f) { return !find(f, level); }),
+               list.end());
+    for (int f : changed)
+      if (find(f, level) && std::find(list.begin(), list.end(), f) == list.end())
+        list.push_back(f);
+  }
+  int n_levels = levels.size();
+#pragma omp parallel for schedule(dynamic)
+  for (int k = 0; k < n_levels; ++k)
+    chain(mesh, levels[k]);
+}
+
+size_t Contours::size() const {
+  size_t result = 0;
+  for (const auto &level : lines)
+    result += level.size();
+  return result;
+}
+
+bool Contours::save(const std::string &filename) const {
+  try {
+    std::ofstream f(filename.c_str());
+    f.exceptions(std::ios::failbit | std::ios::badbit);
+    size_t index = 1;
+    forEach([&](const Polyline &line) {
+        f << "# level " << line.level << std::endl;
+        for (const auto &p : line.points)
+          f << "v " << p[0] << ' ' << p[1] << ' ' << p[2] << std::endl;
+        f << 'l';
+        for (size_t i = 0; i < line.points.size(); ++i)
+          f << ' ' << index + i;
+        if (line.closed)
+          f << ' ' << index;
+        f << std::endl;
+        index += line.points.size();
+      });
+  } catch(std::ifstream::failure &) {
+    return false;
+  }
+  return true;
+}
+
+// A vertex is above level k when its height is >= k, so a face crosses the levels
+// in (min height, max height], and each halfedge crosses the levels between its ends.
+void Contours::extractFace(const MyMesh &mesh, MyMesh::FaceHandle f) {
+  auto &result = segments[f.idx()];
+  result.clear();
+  MyMesh::HalfedgeHandle h[3];
+  double a[3];
+  int i = 0;
+  for (auto he : mesh.fh_range(f)) {
+    h[i] = he;
+    a[i++] = heights[mesh.from_vertex_handle(he).idx()];
+  }
+  double lo = std::min({ a[0], a[1], a[2] }), hi = std::max({ a[0], a[1], a[2] });
+  for (int level = (int)std::floor(lo) + 1; level <= hi; ++level) {
+    Segment s;
+    s.level = level;
+    for (int j = 0; j < 3; ++j) {
+      double from = a[j], to = a[(j+1)%3];
+      if ((from >= level) == (to >= level))
+        continue;
+      const auto &p = mesh.point(mesh.from_vertex_handle(h[j]));
+      const auto &q = mesh.point(mesh.to_vertex_handle(h[j]));
+      auto x = p + (q - p) * ((level - from) / (to - from));
+      if (from >= level) {
+        s.entry = h[j].idx();
+        s.from = x;
+      } else {
+        s.exit = h[j].idx();
+        s.to = x;
+      }
+    }
+    result.push_back(s);
+  }
+}
+
+const Contours::Segment *Contours::find(int face, int level) const {
+  const auto &list = segments[face];
+  if (list.empty() || level < list.front().level || level > list.back().level)
+    return nullptr;
+  return &list[level-list.front().level];
+}
+
+void Contours::chain(const MyMesh &mesh, int level) {
+  auto &result = lines[level-min_level];
+  result.clear();
+  auto &list = faces[level-min_level];
+  std::sort(list.begin(), list.end());
+  std::vector<bool> visited(list.size(), false);
+  auto visit = [&](int face) {
+    visited[std::lower_bound(list.begin(), list.end(), face) - list.begin()] = true;
+  };
+  auto next = [&](int halfedge) -> int {
+    auto opp = mesh.opposite_halfedge_handle(MyMesh::HalfedgeHandle(halfedge));
+    return mesh.is_boundary(opp) ? -1 : mesh.face_handle(opp).idx();
+  };
+
+  for (size_t i = 0; i < list.size(); ++i) {
+    if (visited[i])
+      continue;
+    int start = list[i];
+    Polyline line;
+    line.level = level;
+    line.closed = false;
+    const auto *s = find(start, level);
+    visited[i] = true;
+    line.points.push_back(s->from);
+    line.points.push_back(s->to);
+
+    // Forward, through the exit halfedges
+    int f = next(s->exit);
+    while (f >= 0 && f != start) {
+      s = find(f, level);
+      visit(f);
+      line.points.push_back(s->to);
+      f = next(s->exit);
+    }
+    if (f == start) {
+      line.closed = true;
+      line.points.pop_back();   // the first point again
+    } else {
+      // Backward, through the entry halfedges
+      std::vector<Vector> prefix;
+      s = find(start, level);
+      f = next(s->entry);
+      while (f >= 0) {
+        s = find(f, level);
+        visit(f);
+        prefix.push_back(s->from);
+        f = next(s->entry);
+      }
+      line.points.insert(line.points.begin(), prefix.rbegin(), prefix.rend());
+    }
+    result.push_back(std::move(line));
+  }
+}
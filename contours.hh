@@ -0,0 +1,59 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "mesh.hh"
+
+// Contour lines of the height dot(p, dir) * scaling on a triangle mesh, at integer heights
+// (as the borders of the slicing stripes), by marching triangles.
+// Each face yields one segment per level it crosses, oriented from the halfedge going down
+// to the halfedge going up, so that consecutive segments meet on opposite halfedges.
+// Faces are processed in parallel, then the segments of each level are chained into
+// polylines, the levels also in parallel.
+// After moving vertices, only the faces around them are recomputed, and only the levels
+// these faces crossed (before or after) are chained again.
+class Contours {
+public:
+  struct Polyline {
+    int level;
+    bool closed;
+    std::vector<Vector> points;
+  };
+
+  void extract(const MyMesh &mesh, const Vector &dir, double scaling);
+  void update(const MyMesh &mesh, const std::vector<MyMesh::VertexHandle> &moved);
+
+  // Calls f(polyline) for each polyline, by increasing level.
+  template <typename F> void forEach(F f) const;
+  size_t size() const;
+
+  // Writes the polylines as OBJ line elements.
+  bool save(const std::string &filename) const;
+
+private:
+  struct Segment {
+    int level;
+    int entry, exit;            // halfedges (going down / up)
+    Vector from, to;
+  };
+
+  void extractFace(const MyMesh &mesh, MyMesh::FaceHandle f);
+  const Segment *find(int face, int level) const;
+  void chain(const MyMesh &mesh, int level);
+
+  Vector dir;
+  double scaling;
+  std::vector<double> heights;                  // per vertex
+  std::vector<std::vector<Segment>> segments;   // per face, by increasing level
+  int min_level;
+  std::vector<std::vector<int>> faces;          // per level: the faces crossing it
+  std::vector<std::vector<Polyline>> lines;     // per level
+};
+
+template <typename F> void Contours::forEach(F f) const {
+  for (const auto &level : lines)
+    for (const auto &line : level)
+      f(line);
+}
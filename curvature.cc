@@ -0,0 +1,314 @@
+#include "curvature.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <Eigen/Cholesky>
+#include <Eigen/Eigenvalues>
+
+#include "tessellation.hh"
+
+namespace {
+
+  // Rotates the (u,v) system of the plane defined by `old_normal`
+  // to be coplanar with the plane defined by `new_normal`.
+  void rotateSystem(const Vector &old_normal, const Vector &new_normal, Vector &u, Vector &v) {
+    double ndot = old_normal | new_normal;
+    if (ndot <= -1.0) {
+      u = -u;
+      v = -v;
+      return;
+    }
+    auto perp_old = new_normal - old_normal * ndot;
+    auto dperp = (old_normal + new_normal) / (1.0 + ndot);
+    u -= dperp * (u | perp_old);
+    v -= dperp * (v | perp_old);
+  }
+
+}
+
+void CurvatureFields::reset(size_t n) {
+  for (auto &field : values)
+    field.assign(n, std::numeric_limits<double>::quiet_NaN());
+  for (auto &field : directions)
+    field.assign(n, Vector(0, 0, 0));
+}
+
+const char *CurvatureFields::name(Field field) {
+  static const char *names[] = {
+    "mean curvature", "Gaussian curvature",
+    "minimal principal curvature", "maximal principal curvature",
+    "E", "F", "G", "L", "M", "N"
+  };
+  return names[field];
+}
+
+void localSystem(const Vector &normal, Vector &u, Vector &v) {
+  int maxi = 0, nexti = 1;
+  double max = std::abs(normal[0]), next = std::abs(normal[1]);
+  if (max < next) {
+    std::swap(max, next);
+    std::swap(maxi, nexti);
+  }
+  if (std::abs(normal[2]) > max) {
+    nexti = maxi;
+    maxi = 2;
+  } else if (std::abs(normal[2]) > next)
+    nexti = 2;
+
+  u.vectorize(0.0);
+  u[nexti] = -normal[maxi];
+  u[maxi] = normal[nexti];
+  u /= u.norm();
+  v = normal % u;
+}
+
+double voronoiWeight(const MyMesh &mesh, const MeshGeometry &geometry, MyMesh::HalfedgeHandle in_he) {
+  if (mesh.is_boundary(in_he))
+    return 0;
+  auto next = mesh.next_halfedge_handle(in_he);
+  auto prev = mesh.prev_halfedge_handle(in_he);
+  const auto &in = geometry.halfedges[in_he.idx()];
+  const auto &gamma = geometry.halfedges[next.idx()];
+  const auto &beta = geometry.halfedges[prev.idx()];
+  double c2 = in.length2, b2 = gamma.length2, a2 = beta.length2;
+
+  if (a2 + b2 < c2)                // obtuse gamma
+    return 0.125 * b2 * in.tan();
+  if (a2 + c2 < b2)                // obtuse beta
+    return 0.125 * c2 * in.tan();
+  if (b2 + c2 < a2) {              // obtuse alpha
+    double total_area = geometry.area[mesh.face_handle(in_he).idx()];
+    return total_area - 0.125 * (b2 * gamma.tan() + c2 * beta.tan());
+  }
+
+  double r2 = 0.25 * a2 / std::pow(in.sin, 2); // squared circumradius
+  auto area = [r2](double x2) {
+    return 0.125 * std::sqrt(x2) * std::sqrt(std::max(4.0 * r2 - x2, 0.0));
+  };
+  return area(b2) + area(c2);
+}
+
+namespace {
+
+  // Principal curvatures from the mean and Gaussian curvatures
+  void setPrincipal(CurvatureFields &fields, size_t i, double mean, double gauss) {
+    double d = std::sqrt(std::max(mean * mean - gauss, 0.0));
+    fields.values[CurvatureFields::MIN_PRINCIPAL][i] = mean - d;
+    fields.values[CurvatureFields::MAX_PRINCIPAL][i] = mean + d;
+  }
+
+  void dihedralCurvature(const MyMesh &mesh, const MeshGeometry &geometry, MyMesh::VertexHandle v,
+                         CurvatureFields &fields) {
+    // Compute triangle strip area and angle sum
+    double vertex_area = 0, angle_sum = 0;
+    for (auto h : mesh.vih_range(v))
+      if (!mesh.is_boundary(h)) {
+        vertex_area += geometry.area[mesh.face_handle(h).idx()];
+        const auto &he = geometry.halfedges[h.idx()];
+        angle_sum += std::atan2(he.sin, he.cos);
+      }
+    vertex_area /= 3.0;
+
+    // Compute mean value using dihedral angles
+    double mean = 0;
+    for (auto h : mesh.vih_range(v)) {
+      double angle = geometry.dihedral[mesh.edge_handle(h).idx()];
+      mean += angle * geometry.halfedges[h.idx()].length;
+    }
+    mean *= 0.25 / vertex_area;
+
+    // Gaussian curvature by the angle defect (half of it on the boundary)
+    double defect = (mesh.is_boundary(v) ? M_PI : 2 * M_PI) - angle_sum;
+    double gauss = defect / vertex_area;
+
+    size_t i = v.idx();
+    fields.values[CurvatureFields::MEAN][i] = mean;
+    fields.values[CurvatureFields::GAUSSIAN][i] = gauss;
+    setPrincipal(fields, i, mean, gauss);
+  }
+
+  // Second fundamental form (e,f,g) of a face, in its local (u,v) system.
+  void faceForm(const MyMesh &mesh, const MeshGeometry &geometry, MyMesh::FaceHandle f,
+                Vector &u, Vector &v, Vector &efg) {
+    localSystem(mesh.normal(f), u, v);
+
+    // Normal equations of the 6x3 system, where each edge contributes the rows
+    //   [(e|u) (e|v)   0  ] [e f g]^T = (dn|u)
+    //   [  0   (e|u) (e|v)] [e f g]^T = (dn|v)
+    Eigen::Matrix3d AtA = Eigen::Matrix3d::Zero();
+    Eigen::Vector3d Atb = Eigen::Vector3d::Zero();
+    for (auto h : mesh.fh_range(f)) {
+      const auto &e = geometry.halfedges[h.idx()].vec;
+      auto dn = mesh.normal(mesh.to_vertex_handle(h)) - mesh.normal(mesh.from_vertex_handle(h));
+      double a = e | u, b = e | v, c = dn | u, d = dn | v;
+      AtA(0, 0) += a * a; AtA(0, 1) += a * b;
+      AtA(1, 1) += a * a + b * b; AtA(1, 2) += a * b;
+      AtA(2, 2) += b * b;
+      Atb += Eigen::Vector3d(a * c, b * c + a * d, b * d);
+    }
+    AtA(1, 0) = AtA(0, 1); AtA(2, 1) = AtA(1, 2);
+    Eigen::Vector3d x = AtA.ldlt().solve(Atb);
+    if (x.allFinite())
+      efg = Vector(x(0), x(1), x(2));
+    else
+      efg.vectorize(0.0);
+  }
+
+  // Gathers the face forms around `p` with Voronoi weights, and sets its curvature data.
+  // `form(j, u, v, efg)` should give the local system and form of the face with index j.
+  template <typename FaceFormAccess>
+  void vertexCurvature(const MyMesh &mesh, const MeshGeometry &geometry, MyMesh::VertexHandle p,
+                       FaceFormAccess form, CurvatureFields &fields) {
+    const auto &np = mesh.normal(p);
+    Vector u0, v0;
+    localSystem(np, u0, v0);
+
+    double e = 0.0, f = 0.0, g = 0.0, wp = 0.0;
+    for (auto h : mesh.vih_range(p)) {
+      if (mesh.is_boundary(h))
+        continue;
+      auto fh = mesh.face_handle(h);
+      Vector u, v, x;
+      form(fh, u, v, x);
+
+      // Rotate the (up,vp) local coordinate system to be coplanar with that of the face
+      Vector up = u0, vp = v0;
+      rotateSystem(np, mesh.normal(fh), up, vp);
+
+      // Compute the vertex-local (e,f,g)
+      double u1 = up | u, u2 = up | v;
+      double v1 = vp | u, v2 = vp | v;
+      double w = voronoiWeight(mesh, geometry, h);
+      e += w * (u1 * u1 * x[0] + 2 * u1 * u2 * x[1] + u2 * u2 * x[2]);
+      f += w * (u1 * v1 * x[0] + (u1 * v2 + u2 * v1) * x[1] + u2 * v2 * x[2]);
+      g += w * (v1 * v1 * x[0] + 2 * v1 * v2 * x[1] + v2 * v2 * x[2]);
+      wp += w;
+    }
+    if (wp > 0.0) {
+      e /= wp; f /= wp; g /= wp;
+    }
+
+    // Compute the principal curvatures
+    Eigen::Matrix2d F;
+    F << e, f,
+         f, g;
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix2d> solver;
+    solver.computeDirect(F);    // eigenvalues are sorted in increasing order
+    size_t i = p.idx();
+    double k1 = solver.eigenvalues()(0), k2 = solver.eigenvalues()(1);
+    fields.values[CurvatureFields::MIN_PRINCIPAL][i] = k1;
+    fields.values[CurvatureFields::MAX_PRINCIPAL][i] = k2;
+    fields.values[CurvatureFields::MEAN][i] = (k1 + k2) / 2.0;
+    fields.values[CurvatureFields::GAUSSIAN][i] = k1 * k2;
+    for (int k = 0; k < 2; ++k)
+      fields.directions[k][i] = u0 * solver.eigenvectors()(0, k) + v0 * solver.eigenvectors()(1, k);
+  }
+
+  // Principal direction belonging to k, from the fundamental forms,
+  // in the parametric directions su and sv
+  Vector principalDirection(double k, double E, double F, double G, double L, double M, double N,
+                            const Vector &su, const Vector &sv) {
+    // Both rows of (II - k I) (du, dv)^T = 0 give a solution; use the larger one
+    double a1 = M - k * F, b1 = -(L - k * E);
+    double a2 = N - k * G, b2 = -(M - k * F);
+    double du = a1, dv = b1;
+    if (a2 * a2 + b2 * b2 > a1 * a1 + b1 * b1) {
+      du = a2; dv = b2;
+    }
+    auto d = su * du + sv * dv;
+    double length = d.length();
+    if (length < 1.0e-12 * (su.length() + sv.length()))
+      return Vector(0, 0, 0);   // umbilic
+    return d / length;
+  }
+
+}
+
+void dihedralCurvatures(const MyMesh &mesh, const MeshGeometry &geometry,
+                        CurvatureFields &fields) {
+  int nv = mesh.n_vertices();
+  fields.reset(nv);
+#pragma omp parallel for
+  for (int i = 0; i < nv; ++i)
+    dihedralCurvature(mesh, geometry, MyMesh::VertexHandle(i), fields);
+}
+
+void dihedralCurvatures(const MyMesh &mesh, const MeshGeometry &geometry,
+                        const std::vector<MyMesh::VertexHandle> &vertices,
+                        CurvatureFields &fields) {
+  for (auto v : vertices)
+    dihedralCurvature(mesh, geometry, v, fields);
+}
+
+void principalCurvatures(const MyMesh &mesh, const MeshGeometry &geometry,
+                         CurvatureFields &fields) {
+  // As in the paper:
+  //   S. Rusinkiewicz, Estimating curvatures and their derivatives on triangle meshes.
+  //     3D Data Processing, Visualization and Transmission, IEEE, 2004.
+  // Faces and vertices are processed in two independent passes,
+  // so both loops can run in parallel without synchronization.
+
+  int nf = mesh.n_faces(), nv = mesh.n_vertices();
+  fields.reset(nv);
+
+  std::vector<Vector> face_u(nf), face_v(nf), face_efg(nf);
+#pragma omp parallel for
+  for (int i = 0; i < nf; ++i)
+    faceForm(mesh, geometry, MyMesh::FaceHandle(i), face_u[i], face_v[i], face_efg[i]);
+
+  auto cached = [&](MyMesh::FaceHandle f, Vector &u, Vector &v, Vector &efg) {
+    u = face_u[f.idx()]; v = face_v[f.idx()]; efg = face_efg[f.idx()];
+  };
+#pragma omp parallel for
+  for (int i = 0; i < nv; ++i)
+    vertexCurvature(mesh, geometry, MyMesh::VertexHandle(i), cached, fields);
+}
+
+void principalCurvatures(const MyMesh &mesh, const MeshGeometry &geometry,
+                         const std::vector<MyMesh::VertexHandle> &vertices,
+                         CurvatureFields &fields) {
+  // Only a few faces are shared between the vertices of a local neighborhood,
+  // so the face forms are simply recomputed on demand.
+  auto computed = [&](MyMesh::FaceHandle f, Vector &u, Vector &v, Vector &efg) {
+    faceForm(mesh, geometry, f, u, v, efg);
+  };
+  for (auto p : vertices)
+    vertexCurvature(mesh, geometry, p, computed, fields);
+}
+
+void patchCurvature(size_t i, const Vector &su, const Vector &sv,
+                    const Vector &suu, const Vector &suv, const Vector &svv,
+                    CurvatureFields &fields) {
+  auto n = -patchNormal(su, sv);   // curvatures are signed by su x sv
+  double E = su.sqrnorm(), F = su | sv, G = sv.sqrnorm();
+  double L = n | suu, M = n | suv, N = n | svv;
+  double det = E * G - F * F;
+  double mean = (N * E - 2 * M * F + L * G) / (2 * det);
+  double gauss = (L * N - M * M) / det;
+
+  const double forms[] = { E, F, G, L, M, N };
+  for (int j = 0; j < 6; ++j)
+    fields.values[CurvatureFields::E+j][i] = forms[j];
+  fields.values[CurvatureFields::MEAN][i] = mean;
+  fields.values[CurvatureFields::GAUSSIAN][i] = gauss;
+  setPrincipal(fields, i, mean, gauss);
+  for (int k = 0; k < 2; ++k) {
+    double kappa = fields.values[CurvatureFields::MIN_PRINCIPAL+k][i];
+    fields.directions[k][i] = principalDirection(kappa, E, F, G, L, M, N, su, sv);
+  }
+}
+
+void patchCurvatures(const MyMesh &mesh, const Patch &patch, CurvatureFields &fields) {
+  int nv = mesh.n_vertices();
+  fields.reset(nv);
+#pragma omp parallel for
+  for (int i = 0; i < nv; ++i) {
+    const auto &data = mesh.data(MyMesh::VertexHandle(i));
+    auto &der = EvaluationWorkspace::local().der;
+    patch.evaluate(data.u, data.v, 2, der);
+    patchCurvature(i, der[1][0], der[0][1], der[2][0], der[1][1], der[0][2], fields);
+  }
+}
@@ -0,0 +1,59 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <vector>
+
+#include "geometry.hh"
+#include "patch.hh"
+
+enum class CurvatureEstimator { DIHEDRAL, RUSINKIEWICZ };
+
+// Per-vertex differential geometric quantities, one array for each (structure of arrays),
+// all computed in the same pass, so any of them can be displayed without recomputation.
+// Quantities that the method used cannot give are NaN.
+struct CurvatureFields {
+  enum Field {
+    MEAN, GAUSSIAN, MIN_PRINCIPAL, MAX_PRINCIPAL,
+    E, F, G,                    // first fundamental form (parametric surfaces only)
+    L, M, N,                    // second fundamental form (parametric surfaces only)
+    N_FIELDS
+  };
+
+  std::vector<double> values[N_FIELDS];
+  std::vector<Vector> directions[2]; // principal directions (of MIN_ and MAX_PRINCIPAL)
+
+  // Sets the size to n vertices, with all values NaN and all directions zero.
+  void reset(size_t n);
+  static const char *name(Field field);
+};
+
+// Generates an orthogonal (u,v) coordinate system in the plane defined by `normal`.
+void localSystem(const Vector &normal, Vector &u, Vector &v);
+
+// Returns the area of the triangle bounded by in_he that is closest
+// to the vertex pointed to by in_he.
+double voronoiWeight(const MyMesh &mesh, const MeshGeometry &geometry, MyMesh::HalfedgeHandle in_he);
+
+// Sets the mean curvature (from dihedral angles), the Gaussian curvature (from angle defects)
+// and the principal curvatures (from these) for all (or the given) vertices;
+// the geometry should be up-to-date.
+void dihedralCurvatures(const MyMesh &mesh, const MeshGeometry &geometry,
+                        CurvatureFields &fields);
+void dihedralCurvatures(const MyMesh &mesh, const MeshGeometry &geometry,
+                        const std::vector<MyMesh::VertexHandle> &vertices,
+                        CurvatureFields &fields);
+
+// Sets the principal curvatures and directions, and the mean and Gaussian curvatures,
+// for all (or the given) vertices; the geometry and the vertex normals should be up-to-date.
+void principalCurvatures(const MyMesh &mesh, const MeshGeometry &geometry,
+                         CurvatureFields &fields);
+void principalCurvatures(const MyMesh &mesh, const MeshGeometry &geometry,
+                         const std::vector<MyMesh::VertexHandle> &vertices,
+                         CurvatureFields &fields);
+
+// Sets all fields exactly, from the derivatives of the patch at the (u, v) of each vertex.
+void patchCurvatures(const MyMesh &mesh, const Patch &patch, CurvatureFields &fields);
+// Sets all fields of vertex i from the first and second derivatives of a surface there.
+void patchCurvature(size_t i, const Vector &su, const Vector &sv,
+                    const Vector &suu, const Vector &suv, const Vector &svv,
+                    CurvatureFields &fields);
@@ -0,0 +1,147 @@
+#include "curve.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+
+  // 8-point Gauss-Legendre rule on [-1, 1]; symmetric, so only the positive nodes are given
+  constexpr size_t GAUSS_POINTS = 4;
+  constexpr double GAUSS_NODES[GAUSS_POINTS] = {
+    0.1834346424956498, 0.5255324099163290, 0.7966664774136267, 0.9602898564975363
+  };
+  constexpr double GAUSS_WEIGHTS[GAUSS_POINTS] = {
+    0.3626837833783620, 0.3137066458778873, 0.2223810344533745, 0.1012285362903763
+  };
+
+  Vector contract(const std::vector<Vector> &points, const std::vector<double> &coeffs) {
+    Vector p(0, 0, 0);
+    for (size_t i = 0; i < points.size(); ++i)
+      p += points[i] * coeffs[i];
+    return p;
+  }
+
+}
+
+Vector Curve::evaluate(double u, size_t derivatives, std::vector<Vector> &der) const {
+  auto &coeffs = EvaluationWorkspace::local().coeffs[0];
+  basisFunctions(trigonometric, degree, u, derivatives, coeffs);
+  EvaluationWorkspace::grow(der, derivatives + 1);
+  for (size_t d = 0; d <= derivatives; ++d)
+    der[d] = contract(control_points, coeffs[d]);
+  return der[0];
+}
+
+Vector Curve::evaluate(double u) const {
+  auto &coeffs = EvaluationWorkspace::local().coeffs[0];
+  basisFunctions(trigonometric, degree, u, 0, coeffs);
+  return contract(control_points, coeffs[0]);
+}
+
+void Curve::evaluate(const std::vector<double> &u, size_t derivatives,
+                     std::vector<std::vector<Vector>> &der) const {
+  if (der.size() < derivatives + 1)
+    der.resize(derivatives + 1);
+  for (size_t d = 0; d <= derivatives; ++d)
+    der[d].resize(u.size());
+  int n = u.size();
+#pragma omp parallel for
+  for (int i = 0; i < n; ++i) {
+    auto &coeffs = EvaluationWorkspace::local().coeffs[0];
+    basisFunctions(trigonometric, degree, u[i], derivatives, coeffs);
+    for (size_t d = 0; d <= derivatives; ++d)
+      der[d][i] = contract(control_points, coeffs[d]);
+  }
+}
+
+void ArcLength::build(const Curve &curve, size_t intervals) {
+  this->curve = curve;
+  size_t n = std::max<size_t>(intervals, 1);
+  lengths.assign(n + 1, 0.0);
+  speeds.resize(n + 1);
+  int count = n + 1;
+#pragma omp parallel for
+  for (int i = 0; i < count; ++i) {
+    double u = (double)i / n;
+    speeds[i] = speed(u);
+    if (i > 0)
+      lengths[i] = integrate((double)(i - 1) / n, u);
+  }
+  for (size_t i = 1; i <= n; ++i)
+    lengths[i] += lengths[i-1];
+}
+
+bool ArcLength::empty() const {
+  return lengths.empty();
+}
+
+double ArcLength::length() const {
+  assert(!empty());
+  return lengths.back();
+}
+
+double ArcLength::length(double u) const {
+  assert(!empty());
+  size_t n = lengths.size() - 1;
+  u = std::min(std::max(u, 0.0), 1.0);
+  size_t i = std::min<size_t>(u * n, n - 1);
+  return lengths[i] + integrate((double)i / n, u);
+}
+
+double ArcLength::parameter(double s) const {
+  assert(!empty());
+  size_t n = lengths.size() - 1;
+  if (s <= 0.0)
+    return 0.0;
+  if (s >= lengths[n])
+    return 1.0;
+
+  // lengths[i] <= s < lengths[i+1]
+  size_t i = std::upper_bound(lengths.begin(), lengths.end(), s) - lengths.begin() - 1;
+  double h = 1.0 / n, u0 = i * h, ds = lengths[i+1] - lengths[i];
+
+  // Hermite interpolation of the normalized parameter over the normalized arc length,
+  // with the slopes bounded by 3 to stay monotone (Fritsch-Carlson)
+  auto slope = [&](double v) { return v > 0.0 ? std::min(ds / (h * v), 3.0) : 3.0; };
+  double m0 = slope(speeds[i]), m1 = slope(speeds[i+1]);
+  double t = (s - lengths[i]) / ds, t2 = t * t, t3 = t2 * t;
+  double x = (t3 - 2 * t2 + t) * m0 + (3 * t2 - 2 * t3) + (t3 - t2) * m1;
+  double u = u0 + h * x;
+
+  // One Newton step on length(u) = s
+  double v = speed(u);
+  if (v > 0.0)
+    u -= (lengths[i] + integrate(u0, u) - s) / v;
+  return std::min(std::max(u, u0), u0 + h);
+}
+
+void ArcLength::sample(size_t n, std::vector<double> &u) const {
+  u.resize(n);
+  if (n < 2) {
+    std::fill(u.begin(), u.end(), 0.0);
+    return;
+  }
+  double total = length();
+  int count = n;
+#pragma omp parallel for
+  for (int k = 0; k < count; ++k)
+    u[k] = parameter(total * k / (n - 1));
+  u.front() = 0.0;
+  u.back() = 1.0;
+}
+
+double ArcLength::speed(double u) const {
+  auto &der = EvaluationWorkspace::local().curve;
+  curve.evaluate(u, 1, der);
+  return der[1].norm();
+}
+
+double ArcLength::integrate(double a, double b) const {
+  double center = (a + b) / 2, half = (b - a) / 2, sum = 0.0;
+  for (size_t k = 0; k < GAUSS_POINTS; ++k) {
+    double x = half * GAUSS_NODES[k];
+    sum += GAUSS_WEIGHTS[k] * (speed(center - x) + speed(center + x));
+  }
+  return sum * half;
+}
@@ -0,0 +1,50 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <vector>
+
+#include "patch.hh"
+
+// Curve with Bernstein or trigonometric basis functions (e.g. toolpaths and profile curves),
+// the one-dimensional counterpart of Patch.
+struct Curve {
+  size_t degree;
+  std::vector<Vector> control_points;
+  bool trigonometric = false;
+
+  // der[d] is the d-th derivative (for d <= derivatives);
+  // der is only grown, so reusing it (e.g. EvaluationWorkspace::curve) avoids allocation
+  Vector evaluate(double u, size_t derivatives, std::vector<Vector> &der) const;
+  Vector evaluate(double u) const;
+  // All parameters at once, in parallel: der[d][i] is the d-th derivative at u[i]
+  void evaluate(const std::vector<double> &u, size_t derivatives,
+                std::vector<std::vector<Vector>> &der) const;
+};
+
+// Arc length parametrization of a curve, from a table of the arc length at uniformly spaced
+// parameters, each interval integrated by 8-point Gauss-Legendre quadrature.
+// The inverse is found by binary search in the table, then cubic Hermite interpolation
+// in the interval (using the speed at its ends) corrected by a Newton step, so a query costs
+// O(log n) plus one application of the quadrature rule, without iterative root finding.
+// On regular curves the relative error of both directions is below 1e-12 with the default
+// table; speeds near zero (cusps) need more intervals.
+class ArcLength {
+public:
+  void build(const Curve &curve, size_t intervals = 256);
+  bool empty() const;
+
+  // The queries need a built table (asserted)
+  double length() const;              // of the whole curve
+  double length(double u) const;      // from 0 to u
+  double parameter(double s) const;   // where length(u) = s (s is clamped to the curve)
+  // Parameters of n >= 2 points at equal arc length along the curve, including the ends
+  void sample(size_t n, std::vector<double> &u) const;
+
+private:
+  double speed(double u) const;
+  double integrate(double a, double b) const;
+
+  Curve curve;
+  std::vector<double> lengths;  // at u = i / intervals
+  std::vector<double> speeds;   // at u = i / intervals
+};
@@ -0,0 +1,133 @@
+#include "fairing.hh"
+
+namespace {
+
+  constexpr double CLOSED_WEIGHT = 1.0;
+
+  // Whether the connected component of each vertex has no boundary
+  std::vector<bool> closedComponents(const MyMesh &mesh) {
+    size_t n = mesh.n_vertices();
+    std::vector<int> component(n, -1);
+    std::vector<bool> component_closed;
+    std::vector<MyMesh::VertexHandle> stack;
+    for (auto seed : mesh.vertices()) {
+      if (component[seed.idx()] >= 0)
+        continue;
+      int c = component_closed.size();
+      bool closed = true;
+      component[seed.idx()] = c;
+      stack.push_back(seed);
+      while (!stack.empty()) {
+        auto v = stack.back();
+        stack.pop_back();
+        closed = closed && !mesh.is_boundary(v);
+        for (auto w : mesh.vv_range(v))
+          if (component[w.idx()] < 0) {
+            component[w.idx()] = c;
+            stack.push_back(w);
+          }
+      }
+      component_closed.push_back(closed);
+    }
+    std::vector<bool> result(n);
+    for (size_t i = 0; i < n; ++i)
+      result[i] = component_closed[component[i]];
+    return result;
+  }
+
+}
+
+Fairing::Fairing() : cached_key(0), n_free(0), n_fixed(0) {
+}
+
+void Fairing::fair(MyMesh &mesh) {
+  // Fixed vertices: the boundary and its neighbors
+  std::vector<bool> new_fixed(mesh.n_vertices(), false);
+  for (auto v : mesh.vertices())
+    if (mesh.is_boundary(v)) {
+      new_fixed[v.idx()] = true;
+      for (auto w : mesh.vv_range(v))
+        new_fixed[w.idx()] = true;
+    }
+
+  auto new_key = key(mesh);
+  if (new_key != cached_key || new_fixed != fixed) {
+    fixed = new_fixed;
+    setup(mesh, closedComponents(mesh));
+    cached_key = new_key;
+  }
+  if (n_free == 0 || solver.info() != Eigen::Success)
+    return;
+
+  Eigen::MatrixX3d x_free(n_free, 3), x_fixed(n_fixed, 3);
+  for (auto v : mesh.vertices()) {
+    const auto &p = mesh.point(v);
+    int i = index[v.idx()];
+    if (fixed[v.idx()])
+      x_fixed.row(i) << p[0], p[1], p[2];
+    else
+      x_free.row(i) << p[0], p[1], p[2];
+  }
+
+  Eigen::MatrixX3d rhs = weights.asDiagonal() * x_free - coupling * x_fixed;
+  Eigen::MatrixX3d x = solver.solve(rhs);
+
+  for (auto v : mesh.vertices())
+    if (!fixed[v.idx()]) {
+      int i = index[v.idx()];
+      mesh.set_point(v, Vector(x(i, 0), x(i, 1), x(i, 2)));
+    }
+}
+
+uint64_t Fairing::key(const MyMesh &mesh) const {
+  // FNV-1a hash of the connectivity
+  uint64_t hash = 14695981039346656037ULL;
+  auto add = [&](uint64_t x) {
+    hash ^= x;
+    hash *= 1099511628211ULL;
+  };
+  add(mesh.n_vertices());
+  for (auto f : mesh.faces())
+    for (auto v : mesh.fv_range(f))
+      add(v.idx());
+  return hash;
+}
+
+void Fairing::setup(const MyMesh &mesh, const std::vector<bool> &closed) {
+  n_free = n_fixed = 0;
+  index.resize(mesh.n_vertices());
+  for (auto v : mesh.vertices())
+    index[v.idx()] = fixed[v.idx()] ? n_fixed++ : n_free++;
+  weights.resize(n_free);
+  for (auto v : mesh.vertices())
+    if (!fixed[v.idx()])
+      weights[index[v.idx()]] = closed[v.idx()] ? CLOSED_WEIGHT : 0.0;
+
+  // Columns of the graph Laplacian (D - A) belonging to free and fixed vertices
+  using Triplet = Eigen::Triplet<double>;
+  std::vector<Triplet> free_triplets, fixed_triplets;
+  for (auto v : mesh.vertices()) {
+    int i = v.idx();
+    auto &diagonal = fixed[i] ? fixed_triplets : free_triplets;
+    diagonal.emplace_back(i, index[i], mesh.valence(v));
+    for (auto w : mesh.vv_range(v)) {
+      int j = w.idx();
+      auto &triplets = fixed[j] ? fixed_triplets : free_triplets;
+      triplets.emplace_back(i, index[j], -1.0);
+    }
+  }
+  int n = mesh.n_vertices();
+  Eigen::SparseMatrix<double> K_free(n, n_free), K_fixed(n, n_fixed);
+  K_free.setFromTriplets(free_triplets.begin(), free_triplets.end());
+  K_fixed.setFromTriplets(fixed_triplets.begin(), fixed_triplets.end());
+
+  Eigen::SparseMatrix<double> W(n_free, n_free);
+  W.reserve(Eigen::VectorXi::Constant(n_free, 1));
+  for (int i = 0; i < n_free; ++i)
+    W.insert(i, i) = weights[i];
+  Eigen::SparseMatrix<double> A = K_free.transpose() * K_free + W;
+  coupling = K_free.transpose() * K_fixed;
+
+  // The symbolic analysis and the numeric factorization are both kept
+  solver.compute(A);
+}
@@ -0,0 +1,37 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Sparse>
+
+#include "mesh.hh"
+
+// Implicit fairing with the (uniform) bi-Laplacian, minimizing |K x|^2 + sum w_i |x_i - x0_i|^2,
+// where K is the graph Laplacian. The boundary and its 1-ring are fixed (C1 continuity), and
+// on connected components with a boundary w = 0, so these get the converged fair surface.
+// On a closed component every constant position minimizes |K x|^2, i.e. the converged result
+// is the component collapsed to a point, so there w = 1, and one solve is a single implicit
+// (backward Euler) step of bi-Laplacian flow; fairing again continues the flow.
+// The matrix depends only on the topology and the fixed set, so its factorization is kept
+// as long as these remain the same, and refairing needs only a back-substitution.
+class Fairing {
+public:
+  Fairing();
+
+  // Moves the free vertices of the mesh to the faired position.
+  void fair(MyMesh &mesh);
+
+private:
+  uint64_t key(const MyMesh &mesh) const;
+  void setup(const MyMesh &mesh, const std::vector<bool> &closed);
+
+  uint64_t cached_key;
+  std::vector<int> index;       // vertex -> row in the free / fixed system
+  std::vector<bool> fixed;
+  int n_free, n_fixed;
+  Eigen::VectorXd weights;      // of the free vertices
+  Eigen::SparseMatrix<double> coupling;                  // K_free^T K_fixed
+  Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> solver;
+};
@@ -0,0 +1,204 @@
+#include "fitting.hh"
+
+#include <algorithm>
+#include <cstring>
+
+#include <Eigen/Eigenvalues>
+
+namespace {
+
+  // D^T D for the second differences of n + 1 values
+  Eigen::MatrixXd secondDifferences(size_t n) {
+    Eigen::MatrixXd result = Eigen::MatrixXd::Zero(n + 1, n + 1);
+    const double d[] = { 1.0, -2.0, 1.0 };
+    for (size_t i = 0; i + 2 <= n; ++i)
+      for (size_t j = 0; j < 3; ++j)
+        for (size_t k = 0; k < 3; ++k)
+          result(i + j, i + k) += d[j] * d[k];
+    return result;
+  }
+
+  // Basis values at the given parameters, one row each
+  Eigen::MatrixXd basisMatrix(const Patch &patch, size_t k, const std::vector<double> &params) {
+    Eigen::MatrixXd result(params.size(), patch.degree[k] + 1);
+    int n = params.size();
+#pragma omp parallel for
+    for (int i = 0; i < n; ++i) {
+      std::vector<std::vector<double>> coeffs;
+      patch.basis(k, params[i], 0, coeffs);
+      for (size_t j = 0; j <= patch.degree[k]; ++j)
+        result(i, j) = coeffs[0][j];
+    }
+    return result;
+  }
+
+}
+
+Fitting::Fitting() : cached_key(0), valid(false), grid(false), rows(0), columns(0) {
+}
+
+bool Fitting::fit(const std::vector<double> &u, const std::vector<double> &v,
+                  const std::vector<Vector> &points, double smoothing, Patch &patch) {
+  auto new_key = key(u, v, smoothing, patch);
+  if (new_key != cached_key) {
+    valid = setupGrid(u, v, smoothing, patch) || setupScattered(u, v, smoothing, patch);
+    cached_key = new_key;
+  }
+  if (!valid)
+    return false;
+
+  size_t n = patch.degree[0], m = patch.degree[1];
+  Eigen::MatrixX3d x((n + 1) * (m + 1), 3);
+  if (grid) {
+    // x = (Pu (x) Pv) diag^-1 (Pu (x) Pv)^T (Bu (x) Bv)^T p, one coordinate at a time
+    Eigen::MatrixXd y(rows, columns);
+    for (int c = 0; c < 3; ++c) {
+      for (size_t k = 0; k < points.size(); ++k)
+        y(cell[k] / columns, cell[k] % columns) = points[k][c];
+      Eigen::MatrixXd b = eigen_u.transpose() * (basis_u.transpose() * y * basis_v) * eigen_v;
+      Eigen::MatrixXd z = eigen_u * b.cwiseProduct(scale) * eigen_v.transpose();
+      for (size_t i = 0; i <= n; ++i)
+        for (size_t j = 0; j <= m; ++j)
+          x(i * (m + 1) + j, c) = z(i, j);
+    }
+  } else {
+    // Right-hand side A^T p, accumulated per thread
+    Eigen::MatrixX3d rhs = Eigen::MatrixX3d::Zero(x.rows(), 3);
+    int samples = points.size();
+#pragma omp parallel
+    {
+      Eigen::MatrixX3d local = Eigen::MatrixX3d::Zero(x.rows(), 3);
+#pragma omp for nowait
+      for (int k = 0; k < samples; ++k) {
+        const auto &p = points[k];
+        for (size_t i = 0; i <= n; ++i)
+          for (size_t j = 0; j <= m; ++j) {
+            double w = values_u(k, i) * values_v(k, j);
+            for (int c = 0; c < 3; ++c)
+              local(i * (m + 1) + j, c) += w * p[c];
+          }
+      }
+#pragma omp critical
+      rhs += local;
+    }
+    x = solver.solve(rhs);
+  }
+
+  for (size_t i = 0; i < patch.control_points.size(); ++i)
+    patch.control_points[i] = Vector(x(i, 0), x(i, 1), x(i, 2));
+  return true;
+}
+
+uint64_t Fitting::key(const std::vector<double> &u, const std::vector<double> &v,
+                      double smoothing, const Patch &patch) const {
+  // FNV-1a hash of everything the system matrix depends on
+  uint64_t hash = 14695981039346656037ULL;
+  auto add = [&](uint64_t x) {
+    hash ^= x;
+    hash *= 1099511628211ULL;
+  };
+  auto addDouble = [&](double x) {
+    uint64_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    add(bits);
+  };
+  add(patch.degree[0]);
+  add(patch.degree[1]);
+  add(patch.trigonometric);
+  addDouble(smoothing);
+  add(u.size());
+  for (size_t k = 0; k < u.size(); ++k) {
+    addDouble(u[k]);
+    addDouble(v[k]);
+  }
+  return hash;
+}
+
+bool Fitting::setupGrid(const std::vector<double> &u, const std::vector<double> &v,
+                        double smoothing, const Patch &patch) {
+  // Check that every (u_i, v_j) pair occurs exactly once
+  std::vector<double> us = u, vs = v;
+  std::sort(us.begin(), us.end());
+  us.erase(std::unique(us.begin(), us.end()), us.end());
+  std::sort(vs.begin(), vs.end());
+  vs.erase(std::unique(vs.begin(), vs.end()), vs.end());
+  rows = us.size();
+  columns = vs.size();
+  if (rows * columns != u.size())
+    return false;
+  cell.resize(u.size());
+  std::vector<bool> seen(u.size(), false);
+  for (size_t k = 0; k < u.size(); ++k) {
+    size_t i = std::lower_bound(us.begin(), us.end(), u[k]) - us.begin();
+    size_t j = std::lower_bound(vs.begin(), vs.end(), v[k]) - vs.begin();
+    cell[k] = i * columns + j;
+    if (seen[cell[k]])
+      return false;
+    seen[cell[k]] = true;
+  }
+
+  size_t n = patch.degree[0], m = patch.degree[1];
+  if (rows <= n || columns <= m)
+    return false;
+  basis_u = basisMatrix(patch, 0, us);
+  basis_v = basisMatrix(patch, 1, vs);
+
+  // Su P = Bu^T Bu P L, with P^T Bu^T Bu P = I and P^T Su P = L
+  double w = smoothing * u.size() / ((n + 1) * (m + 1));
+  double wu = w * (m + 1) / columns, wv = w * (n + 1) / rows;
+  Eigen::GeneralizedSelfAdjointEigenSolver<Eigen::MatrixXd>
+    solver_u(secondDifferences(n), basis_u.transpose() * basis_u),
+    solver_v(secondDifferences(m), basis_v.transpose() * basis_v);
+  if (solver_u.info() != Eigen::Success || solver_v.info() != Eigen::Success)
+    return false;
+  eigen_u = solver_u.eigenvectors();
+  eigen_v = solver_v.eigenvectors();
+  scale.resize(n + 1, m + 1);
+  for (size_t i = 0; i <= n; ++i)
+    for (size_t j = 0; j <= m; ++j)
+      scale(i, j) = 1.0 / (1.0 + wu * solver_u.eigenvalues()(i) + wv * solver_v.eigenvalues()(j));
+  grid = true;
+  return true;
+}
+
+bool Fitting::setupScattered(const std::vector<double> &u, const std::vector<double> &v,
+                             double smoothing, const Patch &patch) {
+  size_t n = patch.degree[0], m = patch.degree[1], size = (n + 1) * (m + 1);
+  values_u = basisMatrix(patch, 0, u);
+  values_v = basisMatrix(patch, 1, v);
+
+  // A^T A, accumulated per thread (lower triangle only)
+  Eigen::MatrixXd normal = Eigen::MatrixXd::Zero(size, size);
+  int samples = u.size();
+#pragma omp parallel
+  {
+    Eigen::MatrixXd local = Eigen::MatrixXd::Zero(size, size);
+    Eigen::VectorXd row(size);
+#pragma omp for nowait
+    for (int k = 0; k < samples; ++k) {
+      for (size_t i = 0; i <= n; ++i)
+        for (size_t j = 0; j <= m; ++j)
+          row(i * (m + 1) + j) = values_u(k, i) * values_v(k, j);
+      local.selfadjointView<Eigen::Lower>().rankUpdate(row);
+    }
+#pragma omp critical
+    normal += local;
+  }
+
+  double w = smoothing * u.size() / size;
+  if (w > 0.0) {
+    Eigen::MatrixXd su = secondDifferences(n), sv = secondDifferences(m);
+    Eigen::MatrixXd mu = values_u.transpose() * values_u * ((n + 1.0) / samples);
+    Eigen::MatrixXd mv = values_v.transpose() * values_v * ((m + 1.0) / samples);
+    for (size_t i = 0; i <= n; ++i)
+      for (size_t j = 0; j <= m; ++j)
+        for (size_t k = 0; k <= n; ++k)
+          for (size_t l = 0; l <= m; ++l)
+            normal(i * (m + 1) + j, k * (m + 1) + l) +=
+              w * (su(i, k) * mv(j, l) + mu(i, k) * sv(j, l));
+  }
+
+  solver.compute(normal);     // uses the lower triangle
+  grid = false;
+  return solver.info() == Eigen::Success;
+}
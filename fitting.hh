@@ -0,0 +1,57 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "patch.hh"
+
+// Least-squares fitting of a patch to (u, v)-parametrized samples, minimizing
+//   sum_k |S(u_k, v_k) - p_k|^2 + w E,
+// where E is the squared norm of the second differences of the control net, those in one
+// direction weighted by the distribution of the samples in the other:
+//   E = x^T (Su (x) (m + 1) Mv + (n + 1) Mu (x) Sv) x,
+// with S = D^T D for second differences D, and Mu, Mv the mean of B B^T over the samples
+// (B being the basis values at u_k or v_k; scaled by the number of basis functions,
+// these are about the identity for uniformly distributed samples).
+// When the parameters form a grid, the collocation matrix is the Kronecker product
+// Bu (x) Bv, Mu and Mv are Bu^T Bu / rows and Bv^T Bv / columns, and the normal equations
+// are diagonalized by the generalized eigenvectors of (Su, Bu^T Bu) and (Sv, Bv^T Bv).
+// Otherwise the dense normal equations are assembled in parallel and Cholesky-factored.
+// Both give the same patch for the same samples.
+// The factorization depends only on the parameters, the degrees, the basis and w,
+// so refitting new positions on the same parameters needs only a back-substitution.
+class Fitting {
+public:
+  Fitting();
+
+  // Sets the control points of the patch, keeping its degrees and basis.
+  // The smoothing weight is relative to the number of samples per control point.
+  // Returns false if the system is singular (e.g. when there are too few samples).
+  bool fit(const std::vector<double> &u, const std::vector<double> &v,
+           const std::vector<Vector> &points, double smoothing, Patch &patch);
+
+private:
+  uint64_t key(const std::vector<double> &u, const std::vector<double> &v,
+               double smoothing, const Patch &patch) const;
+  bool setupGrid(const std::vector<double> &u, const std::vector<double> &v,
+                 double smoothing, const Patch &patch);
+  bool setupScattered(const std::vector<double> &u, const std::vector<double> &v,
+                      double smoothing, const Patch &patch);
+
+  uint64_t cached_key;
+  bool valid, grid;
+
+  // Grid
+  std::vector<size_t> cell;     // sample -> index in the grid (i * columns + j)
+  size_t rows, columns;
+  Eigen::MatrixXd basis_u, basis_v;     // Bu, Bv
+  Eigen::MatrixXd eigen_u, eigen_v;     // generalized eigenvectors
+  Eigen::MatrixXd scale;                // inverse eigenvalues of the whole system
+
+  // Scattered
+  Eigen::MatrixXd values_u, values_v;   // basis values of the samples (one per row)
+  Eigen::LLT<Eigen::MatrixXd> solver;
+};
@@ -0,0 +1,81 @@
+#include "geometry.hh"
+
+#include <cmath>
+
+void MeshGeometry::update(const MyMesh &mesh) {
+  halfedges.resize(mesh.n_halfedges());
+  dihedral.resize(mesh.n_edges());
+  area.resize(mesh.n_faces());
+
+  int n = mesh.n_halfedges();
+#pragma omp parallel for
+  for (int i = 0; i < n; ++i)
+    updateHalfedge(mesh, MyMesh::HalfedgeHandle(i));
+}
+
+void MeshGeometry::update(const MyMesh &mesh, MyMesh::VertexHandle moved) {
+  // Halfedges of the 1-ring faces (including the boundary halfedges)
+  for (auto f : mesh.vf_range(moved))
+    for (auto h : mesh.fh_range(f))
+      updateHalfedge(mesh, h);
+  for (auto h : mesh.voh_range(moved)) {
+    updateHalfedge(mesh, h);
+    updateHalfedge(mesh, mesh.opposite_halfedge_handle(h));
+  }
+  // Edges on the outer side of the 1-ring, whose dihedral angle has changed as well
+  for (auto f : mesh.vf_range(moved))
+    for (auto h : mesh.fh_range(f)) {
+      auto o = mesh.opposite_halfedge_handle(h);
+      if (!mesh.is_boundary(o))
+        updateHalfedge(mesh, o);
+    }
+}
+
+void MeshGeometry::updateHalfedge(const MyMesh &mesh, MyMesh::HalfedgeHandle h) {
+  auto &d = halfedges[h.idx()];
+  d.vec = mesh.calc_edge_vector(h);
+  d.length2 = d.vec.sqrnorm();
+  d.length = std::sqrt(d.length2);
+  d.sin = d.cos = 0.0;
+
+  if (!mesh.is_boundary(h)) {
+    auto f = mesh.face_handle(h);
+    auto out = mesh.calc_edge_vector(mesh.next_halfedge_handle(h));
+    double cross = (out % d.vec).norm(), dot = -(out | d.vec);
+    double denom = std::sqrt(out.sqrnorm() * d.length2);
+    if (denom != 0.0) {
+      d.sin = cross / denom;
+      d.cos = dot / denom;
+    }
+    if (mesh.halfedge_handle(f) == h)
+      area[f.idx()] = cross / 2.0;
+  }
+
+  // The dihedral angle is symmetric, so it is computed only for the even halfedge
+  if (h.idx() % 2 == 0) {
+    auto e = mesh.edge_handle(h);
+    auto o = mesh.opposite_halfedge_handle(h);
+    double angle = 0.0;
+    if (!mesh.is_boundary(h) && !mesh.is_boundary(o) && d.length != 0.0) {
+      const auto &n0 = mesh.normal(mesh.face_handle(h)), &n1 = mesh.normal(mesh.face_handle(o));
+      angle = std::atan2(((n0 % n1) | d.vec) / d.length, n0 | n1);
+    }
+    dihedral[e.idx()] = angle;
+  }
+}
+
+Vector vertexNormal(const MyMesh &mesh, const MeshGeometry &geometry, MyMesh::VertexHandle v) {
+  Vector n(0.0, 0.0, 0.0);
+  for (auto h : mesh.vih_range(v)) {
+    if (mesh.is_boundary(h))
+      continue;
+    const auto &in  = geometry.halfedges[h.idx()];
+    const auto &out = geometry.halfedges[mesh.next_halfedge_handle(h).idx()];
+    double w = in.length2 * out.length2;
+    n += (in.vec % out.vec) / (w == 0.0 ? 1.0 : w);
+  }
+  double len = n.length();
+  if (len != 0.0)
+    n /= len;
+  return n;
+}
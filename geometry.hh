@@ -0,0 +1,36 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <vector>
+
+#include "mesh.hh"
+
+// Geometric quantities of the mesh elements, shared by the normal and curvature computations.
+// The dihedral angles need up-to-date face normals.
+struct MeshGeometry {
+  struct Halfedge {
+    Vector vec;                 // edge vector (from -> to)
+    double length, length2;     // length and squared length
+    double sin, cos;            // sector angle at the `to` vertex (0 at the boundary)
+    double cot() const { return sin == 0.0 ? 0.0 : cos / sin; }
+    double tan() const { return cos == 0.0 ? 0.0 : sin / cos; }
+  };
+
+  std::vector<Halfedge> halfedges;
+  std::vector<double> dihedral;  // signed dihedral angle of each edge (0 at the boundary)
+  std::vector<double> area;      // area of each face
+
+  // Recomputes everything in a single parallel pass over the halfedges.
+  void update(const MyMesh &mesh);
+
+  // Recomputes the elements affected by moving the given vertex.
+  void update(const MyMesh &mesh, MyMesh::VertexHandle moved);
+
+private:
+  void updateHalfedge(const MyMesh &mesh, MyMesh::HalfedgeHandle h);
+};
+
+// Normal weights according to:
+//   N. Max, Weights for computing vertex normals from facet normals.
+//     Journal of Graphics Tools, Vol. 4(2), 1999.
+Vector vertexNormal(const MyMesh &mesh, const MeshGeometry &geometry, MyMesh::VertexHandle v);
@@ -0,0 +1,114 @@
+#include "incremental-tessellation.hh"
+
+#include "tessellation.hh"
+
+namespace {
+
+  // Derivatives by u and v, in the order of IncrementalTessellation::derivatives
+  constexpr size_t ORDER[][2] = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 2, 0 }, { 1, 1 }, { 0, 2 } };
+  enum { S, SU, SV, SUU, SUV, SVV };
+
+  struct Change {
+    size_t k, l;
+    Vector delta;
+  };
+
+}
+
+void IncrementalTessellation::build(const Patch &patch, size_t resolution) {
+  this->patch = patch;
+  this->resolution = resolution;
+  std::vector<std::vector<double>> coeffs;
+  for (size_t dir = 0; dir < 2; ++dir) {
+    size_t n = patch.degree[dir];
+    for (size_t d = 0; d <= 2; ++d)
+      basis[dir][d].resize(resolution * (n + 1));
+    for (size_t i = 0; i < resolution; ++i) {
+      patch.basis(dir, (double)i / (double)(resolution - 1), 2, coeffs);
+      for (size_t d = 0; d <= 2; ++d)
+        std::copy(coeffs[d].begin(), coeffs[d].begin() + n + 1, &basis[dir][d][i*(n+1)]);
+    }
+  }
+
+  // Row by row: contract with the u-basis (and its derivatives), then with the v-basis
+  size_t n = patch.degree[0], m = patch.degree[1];
+  for (auto &der : derivatives)
+    der.resize(resolution * resolution);
+  int rows = resolution;
+#pragma omp parallel for
+  for (int i = 0; i < rows; ++i) {
+    std::vector<Vector> q[3];
+    for (size_t a = 0; a <= 2; ++a) {
+      q[a].assign(m + 1, Vector(0, 0, 0));
+      for (size_t k = 0; k <= n; ++k)
+        for (size_t l = 0; l <= m; ++l)
+          q[a][l] += patch.control_points[k*(m+1)+l] * basis[0][a][i*(n+1)+k];
+    }
+    for (size_t j = 0; j < resolution; ++j)
+      for (size_t d = 0; d < N_DERIVATIVES; ++d) {
+        Vector p(0, 0, 0);
+        for (size_t l = 0; l <= m; ++l)
+          p += q[ORDER[d][0]][l] * basis[1][ORDER[d][1]][j*(m+1)+l];
+        derivatives[d][i*resolution+j] = p;
+      }
+  }
+}
+
+bool IncrementalTessellation::empty() const {
+  return derivatives[S].empty();
+}
+
+bool IncrementalTessellation::update(const Patch &patch, MyMesh &mesh, CurvatureFields &fields,
+                                     std::vector<MyMesh::VertexHandle> &changed) {
+  changed.clear();
+  size_t n = patch.degree[0], m = patch.degree[1], nv = resolution * resolution;
+  bool compatible = !empty() && n == this->patch.degree[0] && m == this->patch.degree[1] &&
+    patch.trigonometric == this->patch.trigonometric &&
+    patch.control_points.size() == this->patch.control_points.size() &&
+    mesh.n_vertices() == nv;
+  for (const auto &values : fields.values)
+    compatible = compatible && values.size() == nv;
+  if (!compatible)
+    return false;
+
+  std::vector<Change> changes;
+  for (size_t k = 0, index = 0; k <= n; ++k)
+    for (size_t l = 0; l <= m; ++l, ++index) {
+      Vector delta = patch.control_points[index] - this->patch.control_points[index];
+      if (delta != Vector(0, 0, 0))
+        changes.push_back({ k, l, delta });
+    }
+  this->patch = patch;
+  if (changes.empty())
+    return true;
+
+  std::vector<char> affected(nv, 0);
+  int rows = resolution;
+#pragma omp parallel for
+  for (int i = 0; i < rows; ++i)
+    for (size_t j = 0; j < resolution; ++j) {
+      size_t index = i * resolution + j;
+      for (const auto &c : changes)
+        for (size_t d = 0; d < N_DERIVATIVES; ++d) {
+          double w = basis[0][ORDER[d][0]][i*(n+1)+c.k] * basis[1][ORDER[d][1]][j*(m+1)+c.l];
+          if (w != 0.0) {
+            derivatives[d][index] += c.delta * w;
+            affected[index] = 1;
+          }
+        }
+      if (!affected[index])
+        continue;
+
+      MyMesh::VertexHandle v(index);
+      const auto &su = derivatives[SU][index], &sv = derivatives[SV][index];
+      mesh.set_point(v, derivatives[S][index]);
+      mesh.set_normal(v, patchNormal(su, sv));
+      patchCurvature(index, su, sv, derivatives[SUU][index], derivatives[SUV][index],
+                     derivatives[SVV][index], fields);
+    }
+
+  for (size_t i = 0; i < nv; ++i)
+    if (affected[i])
+      changed.emplace_back(i);
+  return true;
+}
@@ -0,0 +1,34 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <vector>
+
+#include "curvature.hh"
+
+// Updates a tessellation of a patch (as tessellate, with patchNormals and patchCurvatures)
+// after some of its control points moved, using that the points and all derivatives are
+// linear in the control points: moving P_kl by d moves the derivative (a, b) at (u_i, v_j) by
+// B^(a)_k(u_i) B^(b)_l(v_j) d. With the basis values at the grid stored, and the derivatives
+// up to second order at every vertex, an update costs a few multiply-adds per changed
+// control point and vertex, instead of evaluating the basis and contracting the whole net.
+// Only vertices with a nonzero basis product are touched (both bases have global support,
+// so that is all but some of the boundary rows and columns).
+class IncrementalTessellation {
+public:
+  void build(const Patch &patch, size_t resolution);
+  bool empty() const;
+
+  // The mesh and fields should be those of the patch of the last build or update.
+  // Returns false (changing nothing) when the degrees, basis or resolution differ, otherwise
+  // updates the points, normals and fields of the affected vertices, listed in `changed`.
+  bool update(const Patch &patch, MyMesh &mesh, CurvatureFields &fields,
+              std::vector<MyMesh::VertexHandle> &changed);
+
+private:
+  static constexpr size_t N_DERIVATIVES = 6; // S, Su, Sv, Suu, Suv, Svv
+
+  Patch patch;
+  size_t resolution;
+  std::vector<double> basis[2][3]; // [u or v][derivative][i * (degree + 1) + k]
+  std::vector<Vector> derivatives[N_DERIVATIVES]; // at each vertex
+};
@@ -1,10 +1,71 @@
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <QtCore/QDir>
+#include <QtGui/QGuiApplication>
 #include <QtWidgets/QApplication>
 
 #include "MyWindow.h"
+#include "OffscreenRenderer.h"
+#include "trace.hh"
+#include "trigo-basis.hh"
+
+// Batch mode: sample-framework --render jobs.txt [--threads n] [--cache directory]
+// (without a display, add e.g. `-platform offscreen`); see OffscreenRenderer::readJobs
+static int renderBatch(int &argc, char **argv) {
+  QGuiApplication app(argc, argv); // removes the Qt options
+  size_t threads = 0;
+  TessellationCache cache;
+  bool ok = argc >= 3 && argc % 2 == 1;
+  for (int i = 3; ok && i + 1 < argc; i += 2)
+    if (std::strcmp(argv[i], "--threads") == 0)
+      threads = std::atoi(argv[i+1]);
+    else if (std::strcmp(argv[i], "--cache") == 0) {
+      if (!QDir().mkpath(argv[i+1]) || !cache.open(argv[i+1])) {
+        std::cerr << "Cannot use " << argv[i+1] << " as a cache" << std::endl;
+        return 1;
+      }
+    } else
+      ok = false;
+  if (!ok) {
+    std::cerr << "Usage: " << argv[0] << " --render <jobs> [--threads <n>] [--cache <directory>]"
+              << std::endl;
+    return 2;
+  }
+
+  try {
+    trigoinit("trigo.tab");
+  } catch(std::ifstream::failure &) {
+    std::cerr << "Cannot read trigo.tab, trigonometric patches will not render" << std::endl;
+  }
+
+  std::vector<OffscreenRenderer::Job> jobs;
+  if (!OffscreenRenderer::readJobs(argv[2], jobs))
+    return 1;
+  size_t failed = OffscreenRenderer::render(jobs, threads, &cache);
+  std::cerr << jobs.size() - failed << " of " << jobs.size() << " snapshots rendered"
+            << std::endl;
+  return failed ? 1 : 0;
+}
 
 int main(int argc, char **argv) {
-  QApplication app(argc, argv);
-  MyWindow window(&app);
-  window.show();
-  return app.exec();
+  // When set, the whole session is traced and saved at exit
+  const char *trace_file = std::getenv("SAMPLE_FRAMEWORK_TRACE");
+  Trace::enable(trace_file != nullptr);
+
+  int result;
+  if (argc > 1 && std::strcmp(argv[1], "--render") == 0)
+    result = renderBatch(argc, argv);
+  else {
+    QApplication app(argc, argv);
+    MyWindow window(&app);
+    window.show();
+    result = app.exec();
+  }
+
+  if (trace_file && !Trace::save(trace_file))
+    return 1;
+  return result;
 }
@@ -0,0 +1,68 @@
+#include "mapped-file.hh"
+
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : bytes(nullptr), length(0), mapped(false) {
+}
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+bool MappedFile::open(const std::string &filename) {
+  close();
+#ifndef _WIN32
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    ::close(fd);
+    return false;
+  }
+  length = info.st_size;
+  if (length > 0) {
+    void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      ::close(fd);
+      length = 0;
+      return false;
+    }
+    madvise(p, length, MADV_SEQUENTIAL);
+    bytes = static_cast<const char *>(p);
+    mapped = true;
+  }
+  ::close(fd);                  // the mapping stays valid
+  return true;
+#else
+  std::ifstream f(filename.c_str(), std::ios::binary | std::ios::ate);
+  if (!f)
+    return false;
+  buffer.resize(f.tellg());
+  f.seekg(0);
+  if (!f.read(buffer.data(), buffer.size()))
+    return false;
+  bytes = buffer.data();
+  length = buffer.size();
+  return true;
+#endif
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+  if (mapped)
+    munmap(const_cast<char *>(bytes), length);
+#endif
+  mapped = false;
+  bytes = nullptr;
+  length = 0;
+  buffer.clear();
+  buffer.shrink_to_fit();
+}
@@ -0,0 +1,27 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file, memory-mapped where available (read into memory otherwise).
+class MappedFile {
+public:
+  MappedFile();
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool open(const std::string &filename);
+  void close();
+
+  const char *data() const { return bytes; }
+  size_t size() const { return length; }
+
+private:
+  const char *bytes;
+  size_t length;
+  bool mapped;
+  std::vector<char> buffer;
+};
@@ -0,0 +1,309 @@
+#include "mesh-export.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+#include "byte-order.hh"
+#include "curvature.hh"
+#include "tessellation.hh"
+
+using ByteOrder::littleEndianHost;
+using MeshExport::Attributes;
+using MeshExport::Format;
+
+namespace {
+
+  constexpr size_t BUFFER_SIZE = 1 << 20;
+
+  // Writes the header, then the vertices and faces as they come, through a buffer.
+  // I/O errors throw std::ios::failure.
+  class Writer {
+  public:
+    Writer(Format format, const Attributes &attributes, size_t n_vertices, size_t n_faces)
+      : format(format), attributes(attributes), n_vertices(n_vertices), n_faces(n_faces),
+        used(0), swap(format == Format::GLTF && !littleEndianHost()) {
+      std::fill(min, min + 3, std::numeric_limits<float>::max());
+      std::fill(max, max + 3, std::numeric_limits<float>::lowest());
+    }
+
+    // Returns false if the mesh is too large for the format
+    bool open(const std::string &filename);
+    void vertex(const Vector &p, const Vector &n, double u, double v, double mean);
+    void face(size_t a, size_t b, size_t c);
+    void close();
+
+  private:
+    size_t vertexSize() const {
+      return 4 * (3 + (attributes.normals ? 3 : 0) + (attributes.parameters ? 2 : 0) +
+                  (attributes.mean ? 1 : 0));
+    }
+    std::string plyHeader() const;
+    std::string gltfHeader(size_t &bounds_offset) const;
+    std::string bounds() const;
+
+    template <typename T>
+    void put(T x) {
+      if (used + sizeof(T) > buffer.size())
+        flush();
+      char *p = &buffer[used];
+      std::memcpy(p, &x, sizeof(T));
+      if (swap)
+        std::reverse(p, p + sizeof(T));
+      used += sizeof(T);
+    }
+    void flush() {
+      f.write(buffer.data(), used);
+      used = 0;
+    }
+
+    Format format;
+    Attributes attributes;
+    size_t n_vertices, n_faces;
+    std::ofstream f;
+    std::vector<char> buffer;
+    size_t used;
+    bool swap;                   // glTF is always little-endian, PLY is written as the host
+    float min[3], max[3];        // of the positions, needed in the glTF header
+    std::streampos bounds_position;
+  };
+
+  std::string Writer::plyHeader() const {
+    std::ostringstream s;
+    s << "ply" << std::endl;
+    s << "format " << (littleEndianHost() ? "binary_little_endian" : "binary_big_endian")
+      << " 1.0" << std::endl;
+    s << "element vertex " << n_vertices << std::endl;
+    std::vector<std::string> properties = { "x", "y", "z" };
+    if (attributes.normals)
+      properties.insert(properties.end(), { "nx", "ny", "nz" });
+    if (attributes.parameters)
+      properties.insert(properties.end(), { "u", "v" });
+    if (attributes.mean)
+      properties.push_back("mean");
+    for (const auto &p : properties)
+      s << "property float " << p << std::endl;
+    s << "element face " << n_faces << std::endl;
+    s << "property list uchar int vertex_indices" << std::endl;
+    s << "end_header" << std::endl;
+    return s.str();
+  }
+
+  // Fixed width, so it can be overwritten when the bounds are known
+  std::string Writer::bounds() const {
+    std::ostringstream s;
+    s.imbue(std::locale::classic());
+    s << std::scientific << std::setprecision(8); // exact for floats
+    for (const auto *values : { min, max }) {
+      s << (values == min ? "\"min\":[" : "],\"max\":[");
+      for (size_t k = 0; k < 3; ++k) {
+        float x = min[k] <= max[k] ? values[k] : 0.0f; // no vertices
+        s << (k ? "," : "") << std::setw(16) << x;
+      }
+    }
+    s << "]";
+    return s.str();
+  }
+
+  // GLB header, JSON chunk and the header of the binary chunk;
+  // the vertices are interleaved in the first buffer view, the indices are in the second
+  std::string Writer::gltfHeader(size_t &bounds_offset) const {
+    size_t stride = vertexSize(), vertex_bytes = n_vertices * stride;
+    size_t index_bytes = n_faces * 3 * 4;
+    std::ostringstream s;
+    s.imbue(std::locale::classic());
+    s << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"sample-framework\"},"
+      << "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+      << "\"buffers\":[{\"byteLength\":" << vertex_bytes + index_bytes << "}],"
+      << "\"bufferViews\":["
+      << "{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" << vertex_bytes
+      << ",\"byteStride\":" << stride << ",\"target\":34962},"
+      << "{\"buffer\":0,\"byteOffset\":" << vertex_bytes << ",\"byteLength\":" << index_bytes
+      << ",\"target\":34963}],";
+    std::string attributes_json = "\"POSITION\":0";
+    size_t accessor = 1, offset = 12;
+    auto accessorJSON = [&](const char *type, size_t size) {
+      std::ostringstream a;
+      a << ",{\"bufferView\":0,\"byteOffset\":" << offset << ",\"componentType\":5126,"
+        << "\"count\":" << n_vertices << ",\"type\":\"" << type << "\"}";
+      offset += size;
+      return a.str();
+    };
+    std::string accessors;
+    auto add = [&](const char *name, const char *type, size_t size) {
+      attributes_json += std::string(",\"") + name + "\":" + std::to_string(accessor++);
+      accessors += accessorJSON(type, size);
+    };
+    if (attributes.normals)
+      add("NORMAL", "VEC3", 12);
+    if (attributes.parameters)
+      add("TEXCOORD_0", "VEC2", 8);
+    if (attributes.mean)
+      add("_MEAN", "SCALAR", 4);
+    s << "\"meshes\":[{\"primitives\":[{\"attributes\":{" << attributes_json << "},"
+      << "\"indices\":" << accessor << ",\"mode\":4}]}],"
+      << "\"accessors\":[{\"bufferView\":0,\"byteOffset\":0,\"componentType\":5126,"
+      << "\"count\":" << n_vertices << ",\"type\":\"VEC3\",";
+    std::string json = s.str();
+    bounds_offset = 20 + json.size();
+    json += bounds() + "}" + accessors +
+      ",{\"bufferView\":1,\"componentType\":5125,\"count\":" + std::to_string(n_faces * 3) +
+      ",\"type\":\"SCALAR\"}]}";
+    json.resize((json.size() + 3) / 4 * 4, ' ');
+
+    std::string header(12 + 8, '\0');
+    auto set = [&](std::string &str, size_t at, uint32_t x) {
+      for (size_t i = 0; i < 4; ++i)
+        str[at+i] = (x >> (8 * i)) & 0xff;
+    };
+    size_t total = 12 + 8 + json.size() + 8 + vertex_bytes + index_bytes;
+    set(header, 0, 0x46546C67); // "glTF"
+    set(header, 4, 2);
+    set(header, 8, total);
+    set(header, 12, json.size());
+    set(header, 16, 0x4E4F534A); // "JSON"
+    std::string bin(8, '\0');
+    set(bin, 0, vertex_bytes + index_bytes);
+    set(bin, 4, 0x004E4942); // "BIN"
+    return header + json + bin;
+  }
+
+  bool Writer::open(const std::string &filename) {
+    size_t total = 1024 + n_vertices * vertexSize() + n_faces * 12; // a bound for glTF
+    if (format == Format::PLY ?
+        n_vertices > (size_t)std::numeric_limits<int>::max() :
+        total > std::numeric_limits<uint32_t>::max())
+      return false;
+    f.exceptions(std::ios::failbit | std::ios::badbit);
+    f.open(filename.c_str(), std::ios::binary);
+    if (format == Format::PLY)
+      f << plyHeader();
+    else {
+      size_t bounds_offset;
+      auto header = gltfHeader(bounds_offset);
+      bounds_position = bounds_offset;
+      f.write(header.data(), header.size());
+    }
+    buffer.resize(BUFFER_SIZE);
+    return true;
+  }
+
+  void Writer::vertex(const Vector &p, const Vector &n, double u, double v, double mean) {
+    for (size_t k = 0; k < 3; ++k) {
+      float x = p[k];
+      min[k] = std::min(min[k], x);
+      max[k] = std::max(max[k], x);
+      put(x);
+    }
+    if (attributes.normals)
+      for (size_t k = 0; k < 3; ++k)
+        put<float>(n[k]);
+    if (attributes.parameters) {
+      put<float>(u);
+      put<float>(v);
+    }
+    if (attributes.mean)
+      put<float>(mean);
+  }
+
+  void Writer::face(size_t a, size_t b, size_t c) {
+    if (format == Format::PLY)
+      put<uint8_t>(3);
+    for (size_t i : { a, b, c })
+      if (format == Format::PLY)
+        put<int32_t>(i);
+      else
+        put<uint32_t>(i);
+  }
+
+  void Writer::close() {
+    flush();
+    if (format == Format::GLTF) {
+      f.seekp(bounds_position);
+      f << bounds();
+    }
+    f.close();
+  }
+
+}
+
+namespace MeshExport {
+
+  Format format(const std::string &filename) {
+    auto dot = filename.find_last_of('.');
+    auto ext = dot == std::string::npos ? "" : filename.substr(dot + 1);
+    return ext == "glb" ? Format::GLTF : Format::PLY;
+  }
+
+  bool save(const std::string &filename, const MyMesh &mesh, const std::vector<double> &mean,
+            const Attributes &attributes) {
+    Writer writer(format(filename), attributes, mesh.n_vertices(), mesh.n_faces());
+    try {
+      if (!writer.open(filename))
+        return false;
+      for (auto v : mesh.vertices()) {
+        const auto &data = mesh.data(v);
+        writer.vertex(mesh.point(v), mesh.normal(v), data.u, data.v,
+                      attributes.mean ? mean[v.idx()] : 0.0);
+      }
+      for (auto f : mesh.faces()) {
+        size_t index[3], i = 0;
+        for (auto v : mesh.fv_range(f))
+          index[i++] = v.idx();
+        writer.face(index[0], index[1], index[2]);
+      }
+      writer.close();
+    } catch(std::ios::failure &) {
+      return false;
+    }
+    return true;
+  }
+
+  bool saveTessellation(const std::string &filename, const Patch &patch, size_t resolution,
+                        const Attributes &attributes) {
+    if (resolution < 2)
+      return false;
+    size_t n = resolution, cells = (n - 1) * (n - 1);
+    Writer writer(format(filename), attributes, n * n, 2 * cells);
+    size_t derivatives = attributes.mean ? 2 : (attributes.normals ? 1 : 0);
+    std::vector<Vector> points(n), normals(n);
+    CurvatureFields fields;       // of the current row
+    fields.reset(n);
+    const auto &mean = fields.values[CurvatureFields::MEAN];
+    try {
+      if (!writer.open(filename))
+        return false;
+      for (size_t i = 0; i < n; ++i) {
+        double u = (double)i / (double)(n - 1);
+#pragma omp parallel for
+        for (int j = 0; j < (int)n; ++j) {
+          double v = (double)j / (double)(n - 1);
+          auto &der = EvaluationWorkspace::local().der;
+          points[j] = patch.evaluate(u, v, derivatives, der);
+          if (derivatives == 0)
+            continue;
+          normals[j] = patchNormal(der[1][0], der[0][1]);
+          if (derivatives == 2)
+            patchCurvature(j, der[1][0], der[0][1], der[2][0], der[1][1], der[0][2], fields);
+        }
+        for (size_t j = 0; j < n; ++j)
+          writer.vertex(points[j], normals[j], u, (double)j / (double)(n - 1), mean[j]);
+      }
+      for (size_t i = 0; i < n - 1; ++i)
+        for (size_t j = 0; j < n - 1; ++j) {
+          writer.face(i * n + j, i * n + j + 1, (i + 1) * n + j);
+          writer.face((i + 1) * n + j, i * n + j + 1, (i + 1) * n + j + 1);
+        }
+      writer.close();
+    } catch(std::ios::failure &) {
+      return false;
+    }
+    return true;
+  }
+
+}
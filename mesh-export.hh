@@ -0,0 +1,36 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "patch.hh"
+
+// Export of triangle meshes with per-vertex fields, in binary PLY or binary glTF (.glb).
+// Everything is written in single precision through a fixed-size buffer, so the memory used
+// does not depend on the size of the mesh. In glTF, the mean curvature is the custom
+// attribute _MEAN, and (u, v) is TEXCOORD_0.
+namespace MeshExport {
+
+  enum class Format { PLY, GLTF };
+
+  // By the extension (.glb for glTF, PLY otherwise)
+  Format format(const std::string &filename);
+
+  // Vertex attributes written besides the positions
+  struct Attributes {
+    bool normals = true;
+    bool parameters = true;     // (u, v) in the vertex data
+    bool mean = true;
+  };
+
+  // The mesh with its vertex normals, (u, v) parameters and mean curvature (one per vertex)
+  bool save(const std::string &filename, const MyMesh &mesh, const std::vector<double> &mean,
+            const Attributes &attributes);
+
+  // The triangulation of tessellate(), generated one row of vertices at a time,
+  // so grids too large for a MyMesh can also be written.
+  bool saveTessellation(const std::string &filename, const Patch &patch, size_t resolution,
+                        const Attributes &attributes);
+
+}
@@ -0,0 +1,646 @@
+#include "mesh-loader.hh"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <omp.h>
+
+#include "byte-order.hh"
+#include "mapped-file.hh"
+
+using ByteOrder::littleEndianHost;
+using ByteOrder::load;
+using MeshLoader::Progress;
+using MeshLoader::Result;
+
+namespace {
+
+  // Polygons given by vertex indices (face i is indices[offsets[i]..offsets[i+1]])
+  struct Soup {
+    std::vector<Vector> points;
+    std::vector<int> indices;
+    std::vector<size_t> offsets;
+  };
+
+  constexpr size_t BATCHES = 20;
+
+  // Runs body(i) for i in [0, n) in parallel, in batches, reporting progress in [from, to].
+  template <typename F>
+  bool inBatches(size_t n, int from, int to, const Progress &progress, F body) {
+    size_t step = std::max<size_t>(n / BATCHES, 1);
+    for (size_t start = 0; start < n; start += step) {
+      long end = std::min(n, start + step);
+#pragma omp parallel for schedule(dynamic, 1024)
+      for (long i = start; i < end; ++i)
+        body(i);
+      if (!progress(from + (to - from) * end / n))
+        return false;
+    }
+    return true;
+  }
+
+  // Exclusive prefix sum, in place; returns the total
+  template <typename T>
+  T prefixSum(std::vector<T> &values) {
+    T sum = 0;
+    for (auto &x : values) {
+      T tmp = x;
+      x = sum;
+      sum += tmp;
+    }
+    return sum;
+  }
+
+  std::string extension(const std::string &filename) {
+    auto dot = filename.find_last_of('.');
+    if (dot == std::string::npos)
+      return "";
+    auto ext = filename.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return ext;
+  }
+
+  ///////////////////
+  // STL (binary)  //
+  ///////////////////
+
+  // Triangle soup with coincident corners merged (in the order of their first occurrence)
+  Result readSTL(const MappedFile &file, Soup &soup, const Progress &progress) {
+    const char *data = file.data();
+    size_t size = file.size();
+    if (size < 84)
+      return Result::UNSUPPORTED;
+    bool swap = !littleEndianHost();
+    size_t n_faces = load<uint32_t>(data + 80, swap), n_corners = n_faces * 3;
+    bool text = std::strncmp(data, "solid", 5) == 0;
+    if (84 + 50 * n_faces > size || (text && 84 + 50 * n_faces != size))
+      return Result::UNSUPPORTED;
+
+    using Corner = std::array<float, 3>;
+    std::vector<Corner> corners(n_corners);
+    std::atomic<bool> finite(true);   // NaNs would break the ordering of the sort below
+    if (!inBatches(n_faces, 0, 15, progress, [&](size_t i) {
+          const char *p = data + 84 + 50 * i + 12; // after the normal
+          for (size_t j = 0; j < 3; ++j)
+            for (size_t k = 0; k < 3; ++k) {  // adding 0 makes -0 equal to 0 bitwise
+              corners[3*i+j][k] = load<float>(p + 12 * j + 4 * k, swap) + 0.0f;
+              if (!std::isfinite(corners[3*i+j][k]))
+                finite = false;
+            }
+        }))
+      return Result::CANCELLED;
+    if (!finite)
+      return Result::ERROR;
+
+    // Bucket the corners by a hash of their position (in parallel, by contiguous ranges)
+    constexpr size_t BUCKETS = 4096;
+    auto bucket = [&](size_t i) {
+      uint32_t h = 2166136261u;
+      for (size_t k = 0; k < 3; ++k) {
+        uint32_t bits;
+        std::memcpy(&bits, &corners[i][k], 4);
+        h = (h ^ bits) * 16777619u;
+      }
+      return (h ^ (h >> 12)) % BUCKETS;
+    };
+    int ranges = omp_get_max_threads();
+    size_t range_size = (n_corners + ranges - 1) / ranges;
+    std::vector<size_t> counts(ranges * BUCKETS, 0); // bucket-major
+#pragma omp parallel for
+    for (int r = 0; r < ranges; ++r)
+      for (size_t i = r * range_size, e = std::min(n_corners, i + range_size); i < e; ++i)
+        counts[bucket(i)*ranges+r]++;
+    prefixSum(counts);
+    std::vector<uint32_t> sorted(n_corners);
+#pragma omp parallel for
+    for (int r = 0; r < ranges; ++r) {
+      std::vector<size_t> next(BUCKETS);
+      for (size_t b = 0; b < BUCKETS; ++b)
+        next[b] = counts[b*ranges+r];
+      for (size_t i = r * range_size, e = std::min(n_corners, i + range_size); i < e; ++i)
+        sorted[next[bucket(i)]++] = i;
+    }
+    if (!progress(25))
+      return Result::CANCELLED;
+
+    // In each bucket, sort by position (then index), so the first of a group is its representative
+    std::vector<uint32_t> representative(n_corners);
+    if (!inBatches(BUCKETS, 25, 40, progress, [&](size_t b) {
+          auto begin = sorted.begin() + counts[b*ranges];
+          auto end = b + 1 < BUCKETS ? sorted.begin() + counts[(b+1)*ranges] : sorted.end();
+          std::sort(begin, end, [&](uint32_t i, uint32_t j) {
+              return corners[i] < corners[j] || (corners[i] == corners[j] && i < j);
+            });
+          for (auto it = begin; it != end; ++it)
+            representative[*it] = it != begin && corners[*(it-1)] == corners[*it] ?
+              representative[*(it-1)] : *it;
+        }))
+      return Result::CANCELLED;
+
+    // Number the representatives in order of occurrence
+    std::vector<size_t> first(ranges);
+#pragma omp parallel for
+    for (int r = 0; r < ranges; ++r) {
+      size_t count = 0;
+      for (size_t i = r * range_size, e = std::min(n_corners, i + range_size); i < e; ++i)
+        count += representative[i] == i;
+      first[r] = count;
+    }
+    size_t n_vertices = prefixSum(first);
+    std::vector<int> id(n_corners);
+    soup.points.resize(n_vertices);
+#pragma omp parallel for
+    for (int r = 0; r < ranges; ++r) {
+      size_t next = first[r];
+      for (size_t i = r * range_size, e = std::min(n_corners, i + range_size); i < e; ++i)
+        if (representative[i] == i) {
+          id[i] = next;
+          soup.points[next++] = Vector(corners[i][0], corners[i][1], corners[i][2]);
+        }
+    }
+    soup.indices.resize(n_corners);
+    soup.offsets.resize(n_faces + 1);
+    if (!inBatches(n_faces, 40, 50, progress, [&](size_t i) {
+          for (size_t j = 0; j < 3; ++j)
+            soup.indices[3*i+j] = id[representative[3*i+j]];
+          soup.offsets[i] = 3 * i;
+        }))
+      return Result::CANCELLED;
+    soup.offsets[n_faces] = n_corners;
+    return Result::OK;
+  }
+
+  ///////////////////
+  // PLY (binary)  //
+  ///////////////////
+
+  struct PLYProperty {
+    std::string name;
+    size_t size;                // of the value (or of the elements, for lists)
+    char type;                  // 'i': signed, 'u': unsigned, 'f': floating point
+    size_t count_size;          // 0 for scalars
+    char count_type;
+  };
+
+  struct PLYElement {
+    std::string name;
+    size_t count;
+    std::vector<PLYProperty> properties;
+    bool fixedSize() const {
+      for (const auto &p : properties)
+        if (p.count_size)
+          return false;
+      return true;
+    }
+    size_t recordSize() const {
+      size_t size = 0;
+      for (const auto &p : properties)
+        size += p.size;
+      return size;
+    }
+  };
+
+  bool plyType(const std::string &name, size_t &size, char &type) {
+    static const std::pair<const char *, std::pair<size_t, char>> types[] = {
+      { "char", { 1, 'i' } }, { "int8", { 1, 'i' } }, { "uchar", { 1, 'u' } }, { "uint8", { 1, 'u' } },
+      { "short", { 2, 'i' } }, { "int16", { 2, 'i' } }, { "ushort", { 2, 'u' } }, { "uint16", { 2, 'u' } },
+      { "int", { 4, 'i' } }, { "int32", { 4, 'i' } }, { "uint", { 4, 'u' } }, { "uint32", { 4, 'u' } },
+      { "float", { 4, 'f' } }, { "float32", { 4, 'f' } }, { "double", { 8, 'f' } }, { "float64", { 8, 'f' } }
+    };
+    for (const auto &t : types)
+      if (name == t.first) {
+        size = t.second.first;
+        type = t.second.second;
+        return true;
+      }
+    return false;
+  }
+
+  double plyValue(const char *p, size_t size, char type, bool swap) {
+    switch (type) {
+    case 'f': return size == 4 ? load<float>(p, swap) : load<double>(p, swap);
+    case 'i':
+      switch (size) {
+      case 1: return load<int8_t>(p, swap);
+      case 2: return load<int16_t>(p, swap);
+      default: return load<int32_t>(p, swap);
+      }
+    default:
+      switch (size) {
+      case 1: return load<uint8_t>(p, swap);
+      case 2: return load<uint16_t>(p, swap);
+      default: return load<uint32_t>(p, swap);
+      }
+    }
+  }
+
+  // Parses the header; `start` is set to the beginning of the data
+  bool plyHeader(const MappedFile &file, std::vector<PLYElement> &elements,
+                 bool &binary, bool &little_endian, size_t &start) {
+    const char *data = file.data(), *end = data + file.size();
+    const char *p = data;
+    auto line = [&]() {
+      auto eol = std::find(p, end, '\n');
+      std::string result(p, eol);
+      if (!result.empty() && result.back() == '\r')
+        result.pop_back();
+      p = eol == end ? end : eol + 1;
+      return result;
+    };
+    if (line() != "ply")
+      return false;
+    while (p != end) {
+      auto words = line();
+      std::vector<std::string> w;
+      for (size_t i = 0; i < words.size(); ) {
+        size_t j = words.find(' ', i);
+        if (j == std::string::npos)
+          j = words.size();
+        if (j > i)
+          w.push_back(words.substr(i, j - i));
+        i = j + 1;
+      }
+      if (w.empty() || w[0] == "comment" || w[0] == "obj_info")
+        continue;
+      if (w[0] == "end_header") {
+        start = p - data;
+        return !elements.empty();
+      }
+      if (w[0] == "format" && w.size() >= 2) {
+        binary = w[1] != "ascii";
+        little_endian = w[1] == "binary_little_endian";
+      } else if (w[0] == "element" && w.size() == 3) {
+        elements.push_back({ w[1], std::stoul(w[2]), {} });
+      } else if (w[0] == "property" && !elements.empty()) {
+        PLYProperty prop;
+        prop.count_size = 0;
+        if (w.size() == 5 && w[1] == "list") {
+          if (!plyType(w[2], prop.count_size, prop.count_type) ||
+              !plyType(w[3], prop.size, prop.type))
+            return false;
+          prop.name = w[4];
+        } else if (w.size() == 3) {
+          if (!plyType(w[1], prop.size, prop.type))
+            return false;
+          prop.name = w[2];
+        } else
+          return false;
+        elements.back().properties.push_back(prop);
+      } else
+        return false;
+    }
+    return false;
+  }
+
+  Result readPLY(const MappedFile &file, Soup &soup, const Progress &progress) {
+    std::vector<PLYElement> elements;
+    bool binary = false, little_endian = true;
+    size_t offset = 0;
+    try {
+      if (!plyHeader(file, elements, binary, little_endian, offset))
+        return Result::ERROR;
+    } catch (std::exception &) { // invalid counts
+      return Result::ERROR;
+    }
+    if (!binary)
+      return Result::UNSUPPORTED;
+    bool swap = little_endian != littleEndianHost();
+    const char *data = file.data();
+    size_t size = file.size();
+
+    for (const auto &element : elements) {
+      // Record offsets (for lists, found by a sequential scan of the counts)
+      std::vector<size_t> records;
+      size_t element_start = offset;
+      if (element.fixedSize()) {
+        offset += element.count * element.recordSize();
+        if (offset > size)
+          return Result::ERROR;
+      } else {
+        records.resize(element.count + 1);
+        for (size_t i = 0; i < element.count; ++i) {
+          records[i] = offset;
+          for (const auto &prop : element.properties) {
+            if (offset + prop.count_size > size)
+              return Result::ERROR;
+            size_t count = prop.count_size ?
+              plyValue(data + offset, prop.count_size, prop.count_type, swap) : 1;
+            offset += prop.count_size + count * prop.size;
+          }
+          if (offset > size)
+            return Result::ERROR;
+        }
+        records[element.count] = offset;
+      }
+      auto record = [&](size_t i) {
+        return data + (records.empty() ? element_start + i * element.recordSize() : records[i]);
+      };
+
+      if (element.name == "vertex") {
+        // Offsets of x, y, z inside a (fixed size) record
+        size_t pos[3], sizes[3];
+        char types[3];
+        bool found[3] = { false, false, false };
+        size_t field = 0;
+        for (const auto &prop : element.properties) {
+          for (size_t k = 0; k < 3; ++k)
+            if (prop.name == std::string(1, 'x' + k) && !prop.count_size) {
+              pos[k] = field; sizes[k] = prop.size; types[k] = prop.type; found[k] = true;
+            }
+          field += prop.size;
+        }
+        if (!found[0] || !found[1] || !found[2] || !records.empty())
+          return Result::ERROR;
+        soup.points.resize(element.count);
+        if (!inBatches(element.count, 0, 25, progress, [&](size_t i) {
+              const char *r = record(i);
+              for (size_t k = 0; k < 3; ++k)
+                soup.points[i][k] = plyValue(r + pos[k], sizes[k], types[k], swap);
+            }))
+          return Result::CANCELLED;
+      } else if (element.name == "face") {
+        // The list of vertex indices, after any scalars in the record
+        size_t list = element.properties.size(), field = 0;
+        for (size_t j = 0; j < element.properties.size(); ++j) {
+          const auto &prop = element.properties[j];
+          if (prop.count_size && (prop.name == "vertex_indices" || prop.name == "vertex_index")) {
+            list = j;
+            break;
+          }
+          if (prop.count_size)
+            return Result::UNSUPPORTED; // another list before the indices
+          field += prop.size;
+        }
+        if (list == element.properties.size())
+          return Result::ERROR;
+        const auto &prop = element.properties[list];
+        auto count = [&](size_t i) {
+          return (size_t)plyValue(record(i) + field, prop.count_size, prop.count_type, swap);
+        };
+        soup.offsets.resize(element.count + 1);
+        for (size_t i = 0; i < element.count; ++i)
+          soup.offsets[i] = count(i);
+        soup.offsets[element.count] = 0;
+        soup.indices.resize(prefixSum(soup.offsets));
+        int n_vertices = soup.points.size();
+        std::atomic<bool> valid(true); // written by the worker threads
+        if (!inBatches(element.count, 25, 50, progress, [&](size_t i) {
+              const char *p = record(i) + field + prop.count_size;
+              for (size_t j = soup.offsets[i]; j < soup.offsets[i+1]; ++j, p += prop.size) {
+                int index = plyValue(p, prop.size, prop.type, swap);
+                if (index < 0 || index >= n_vertices)
+                  valid = false;
+                soup.indices[j] = index;
+              }
+            }))
+          return Result::CANCELLED;
+        if (!valid)
+          return Result::ERROR;
+      }
+    }
+    return Result::OK;
+  }
+
+  ///////////
+  // OBJ   //
+  ///////////
+
+  // Number parsing that does not depend on the locale (Qt sets it from the environment)
+  // and stops at the end of the buffer; the result is within a few ulps.
+  const char *parseDouble(const char *p, const char *end, double &x) {
+    static const double powers[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    while (p != end && (*p == ' ' || *p == '\t'))
+      ++p;
+    bool negative = p != end && *p == '-';
+    if (p != end && (*p == '-' || *p == '+'))
+      ++p;
+    uint64_t mantissa = 0;
+    int exponent = 0, digits = 0;
+    for (; p != end && std::isdigit((unsigned char)*p); ++p, ++digits)
+      if (mantissa < 1000000000000000000ull)
+        mantissa = mantissa * 10 + (*p - '0');
+      else
+        exponent++;
+    if (p != end && *p == '.')
+      for (++p; p != end && std::isdigit((unsigned char)*p); ++p, ++digits)
+        if (mantissa < 1000000000000000000ull) {
+          mantissa = mantissa * 10 + (*p - '0');
+          exponent--;
+        }
+    if (digits == 0)
+      return nullptr;
+    if (p != end && (*p == 'e' || *p == 'E')) {
+      const char *q = p + 1;
+      bool negative_exponent = q != end && *q == '-';
+      if (q != end && (*q == '-' || *q == '+'))
+        ++q;
+      if (q != end && std::isdigit((unsigned char)*q)) {
+        int e = 0;
+        for (; q != end && std::isdigit((unsigned char)*q); ++q)
+          e = std::min(e * 10 + (*q - '0'), 10000);
+        exponent += negative_exponent ? -e : e;
+        p = q;
+      }
+    }
+    x = mantissa;
+    while (exponent > 22) {
+      x *= 1e22;
+      exponent -= 22;
+    }
+    while (exponent < -22) {
+      x /= 1e22;
+      exponent += 22;
+    }
+    x = exponent >= 0 ? x * powers[exponent] : x / powers[-exponent];
+    if (negative)
+      x = -x;
+    return p;
+  }
+
+  const char *parseInt(const char *p, const char *end, long &x) {
+    while (p != end && (*p == ' ' || *p == '\t'))
+      ++p;
+    bool negative = p != end && *p == '-';
+    if (p != end && (*p == '-' || *p == '+'))
+      ++p;
+    if (p == end || !std::isdigit((unsigned char)*p))
+      return nullptr;
+    for (x = 0; p != end && std::isdigit((unsigned char)*p); ++p)
+      x = x * 10 + (*p - '0');
+    if (negative)
+      x = -x;
+    return p;
+  }
+
+  struct OBJChunk {
+    const char *begin, *end;
+    size_t vertices, faces, indices; // counts, then the first indices of the chunk
+  };
+
+  // Calls vertex(line) and face(line) for the relevant lines of [begin, end)
+  template <typename V, typename F>
+  void objLines(const char *begin, const char *end, V vertex, F face) {
+    for (const char *p = begin; p < end; ) {
+      const char *eol = std::find(p, end, '\n');
+      while (p != eol && (*p == ' ' || *p == '\t'))
+        ++p;
+      if (eol - p > 1 && (p[1] == ' ' || p[1] == '\t')) {
+        if (*p == 'v')
+          vertex(p + 2, eol);
+        else if (*p == 'f')
+          face(p + 2, eol);
+      }
+      p = eol == end ? end : eol + 1;
+    }
+  }
+
+  // Vertex indices of a face line, with their count; p is advanced past each "v/vt/vn" group
+  template <typename F>
+  bool objFace(const char *p, const char *end, F index) {
+    long x;
+    while (true) {
+      while (p != end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        ++p;
+      if (p == end)
+        return true;
+      p = parseInt(p, end, x);
+      if (!p)
+        return false;
+      index(x);
+      while (p != end && *p != ' ' && *p != '\t' && *p != '\r') // skip /vt/vn
+        ++p;
+    }
+  }
+
+  Result readOBJ(const MappedFile &file, Soup &soup, const Progress &progress) {
+    const char *data = file.data(), *end = data + file.size();
+
+    // Chunks of about 1 MB, on line boundaries
+    std::vector<OBJChunk> chunks;
+    constexpr size_t CHUNK_SIZE = 1 << 20;
+    for (const char *p = data; p < end; ) {
+      const char *q = p + std::min<size_t>(CHUNK_SIZE, end - p);
+      q = std::find(q, end, '\n');
+      q = q == end ? end : q + 1;
+      chunks.push_back({ p, q, 0, 0, 0 });
+      p = q;
+    }
+
+    // First pass: counts
+    std::atomic<bool> valid(true);      // written by the worker threads
+    if (!inBatches(chunks.size(), 0, 15, progress, [&](size_t i) {
+          auto &c = chunks[i];
+          objLines(c.begin, c.end, [&](const char *, const char *) { c.vertices++; },
+                   [&](const char *p, const char *e) {
+                     c.faces++;
+                     if (!objFace(p, e, [&](long) { c.indices++; }))
+                       valid = false;
+                   });
+        }))
+      return Result::CANCELLED;
+    if (!valid)
+      return Result::ERROR;
+    std::vector<size_t> vertices(chunks.size()), faces(chunks.size()), indices(chunks.size());
+    for (size_t i = 0; i < chunks.size(); ++i) {
+      vertices[i] = chunks[i].vertices;
+      faces[i] = chunks[i].faces;
+      indices[i] = chunks[i].indices;
+    }
+    soup.points.resize(prefixSum(vertices));
+    soup.offsets.resize(prefixSum(faces) + 1);
+    soup.indices.resize(prefixSum(indices));
+    soup.offsets.back() = soup.indices.size();
+
+    // Second pass: values (relative indices refer to the vertices read so far)
+    long n_vertices = soup.points.size();
+    if (!inBatches(chunks.size(), 15, 50, progress, [&](size_t i) {
+          auto &c = chunks[i];
+          size_t v = vertices[i], f = faces[i], k = indices[i];
+          objLines(c.begin, c.end,
+                   [&](const char *p, const char *e) {
+                     for (size_t j = 0; j < 3; ++j)
+                       if (!p || !(p = parseDouble(p, e, soup.points[v][j])))
+                         valid = false;
+                     v++;
+                   },
+                   [&](const char *p, const char *e) {
+                     soup.offsets[f++] = k;
+                     objFace(p, e, [&](long x) {
+                         x = x < 0 ? (long)v + x : x - 1;
+                         if (x < 0 || x >= n_vertices)
+                           valid = false;
+                         soup.indices[k++] = x;
+                       });
+                   });
+        }))
+      return Result::CANCELLED;
+    return valid ? Result::OK : Result::ERROR;
+  }
+
+  // Sequential, as OpenMesh builds the halfedge structure face by face.
+  // Faces OpenMesh rejects (e.g. non-manifold ones) are skipped, as are faces with a repeated
+  // vertex (e.g. degenerate triangles after merging corners), which it would accept
+  // with a self-loop edge, corrupting the halfedge structure.
+  Result build(const Soup &soup, MyMesh &mesh, const Progress &progress) {
+    size_t n_faces = soup.offsets.empty() ? 0 : soup.offsets.size() - 1;
+    mesh.reserve(soup.points.size(), soup.indices.size(), n_faces);
+    for (const auto &p : soup.points)
+      mesh.add_vertex(p);
+    if (!progress(55))
+      return Result::CANCELLED;
+    std::vector<MyMesh::VertexHandle> face;
+    size_t step = std::max<size_t>(n_faces / BATCHES, 1);
+    for (size_t i = 0; i < n_faces; ++i) {
+      face.clear();
+      bool repeated = false;
+      for (size_t j = soup.offsets[i]; j < soup.offsets[i+1]; ++j) {
+        MyMesh::VertexHandle v(soup.indices[j]);
+        repeated = repeated || std::find(face.begin(), face.end(), v) != face.end();
+        face.push_back(v);
+      }
+      if (face.size() >= 3 && !repeated)
+        mesh.add_face(face);
+      if ((i + 1) % step == 0 && !progress(55 + 45 * (i + 1) / n_faces))
+        return Result::CANCELLED;
+    }
+    return Result::OK;
+  }
+
+}
+
+namespace MeshLoader {
+
+  Result load(const std::string &filename, MyMesh &mesh, const Progress &progress) {
+    auto ext = extension(filename);
+    if (ext != "stl" && ext != "ply" && ext != "obj")
+      return Result::UNSUPPORTED;
+    MappedFile file;
+    if (!file.open(filename))
+      return Result::ERROR;
+
+    Soup soup;
+    Result result;
+    if (ext == "stl")
+      result = readSTL(file, soup, progress);
+    else if (ext == "ply")
+      result = readPLY(file, soup, progress);
+    else
+      result = readOBJ(file, soup, progress);
+    file.close();
+    mesh.clear();
+    if (result == Result::OK)
+      result = build(soup, mesh, progress);
+    if (result != Result::OK)
+      mesh.clear();
+    return result;
+  }
+
+}
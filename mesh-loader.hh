@@ -0,0 +1,24 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "mesh.hh"
+
+// Loader for large meshes in binary STL, binary PLY and OBJ format.
+// The file is memory-mapped and parsed in parallel (for STL, the coincident corners are also
+// merged in parallel), then the connectivity is built sequentially, as OpenMesh requires.
+// Other formats (and text STL / PLY) are left to OpenMesh::IO::read_mesh.
+namespace MeshLoader {
+
+  enum class Result { OK, UNSUPPORTED, ERROR, CANCELLED };
+
+  // Called between the parallel batches, on the calling thread, with the percentage done;
+  // returning false cancels the loading.
+  using Progress = std::function<bool(int)>;
+
+  // On failure or cancellation the mesh is left empty.
+  Result load(const std::string &filename, MyMesh &mesh, const Progress &progress);
+
+}
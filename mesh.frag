@@ -0,0 +1,50 @@
+#version 120
+
+// Visualization modes, as in MeshShader::Mode
+const int PLAIN = 0, MEAN = 1, SLICING = 2, ISOPHOTES = 3;
+
+uniform int mode;
+uniform float mean_min, mean_max;
+uniform vec3 slicing;           // direction scaled by the slicing density
+uniform sampler1D map1d;        // color map (MEAN) or slicing stripes (SLICING)
+uniform sampler2D map2d;        // sphere map (ISOPHOTES)
+
+varying vec3 position;
+varying vec3 normal;
+varying vec3 model_position;
+varying float mean;
+
+// Two-sided lighting with the first light source, as with GL_COLOR_MATERIAL
+vec3 shade(vec3 color) {
+  vec3 n = normalize(gl_FrontFacing ? normal : -normal);
+  vec4 light = gl_LightSource[0].position;
+  vec3 l = normalize(light.xyz - position * light.w);
+  vec3 h = normalize(l + normalize(-position));
+  vec3 result = color * (gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb +
+                         gl_LightSource[0].diffuse.rgb * max(dot(n, l), 0.0));
+  if (gl_FrontMaterial.shininess > 0.0)
+    result += gl_FrontMaterial.specular.rgb * gl_LightSource[0].specular.rgb *
+      pow(max(dot(n, h), 0.0), gl_FrontMaterial.shininess);
+  return result;
+}
+
+void main() {
+  if (mode == MEAN) {
+    // Negative values map to [0, 0.5), positive values to (0.5, 1]
+    float t;
+    if (mean < 0.0)
+      t = 0.5 - 0.5 * (mean_min != 0.0 ? min(mean / mean_min, 1.0) : 1.0);
+    else
+      t = 0.5 + 0.5 * (mean_max != 0.0 ? min(mean / mean_max, 1.0) : 1.0);
+    gl_FragColor = vec4(shade(texture1D(map1d, (t * 255.0 + 0.5) / 256.0).rgb), 1.0);
+  } else if (mode == SLICING) {
+    gl_FragColor = vec4(texture1D(map1d, dot(model_position, slicing)).rgb, 1.0);
+  } else if (mode == ISOPHOTES) {
+    // Sphere mapping (as GL_SPHERE_MAP), decaled onto the lit surface
+    vec3 r = reflect(normalize(position), normalize(normal));
+    float m = 2.0 * sqrt(r.x * r.x + r.y * r.y + (r.z + 1.0) * (r.z + 1.0));
+    vec4 texel = texture2D(map2d, r.xy / m + 0.5);
+    gl_FragColor = vec4(mix(shade(vec3(1.0)), texel.rgb, texel.a), 1.0);
+  } else
+    gl_FragColor = vec4(shade(vec3(1.0)), 1.0);
+}
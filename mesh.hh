@@ -0,0 +1,14 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <OpenMesh/Core/Mesh/TriMesh_ArrayKernelT.hh>
+
+struct MyTraits : public OpenMesh::DefaultTraits {
+  using Point  = OpenMesh::Vec3d; // the default would be Vec3f
+  using Normal = OpenMesh::Vec3d;
+  VertexTraits {
+    double u, v;              // parameters (for Bezier surfaces)
+  };
+};
+using MyMesh = OpenMesh::TriMesh_ArrayKernelT<MyTraits>;
+using Vector = OpenMesh::VectorT<double,3>;
@@ -0,0 +1,19 @@
+#version 120
+
+// Positions and normals come from the fixed-function arrays,
+// the mean curvature is a separate scalar attribute.
+
+attribute float curvature;
+
+varying vec3 position;          // in eye space
+varying vec3 normal;            // in eye space
+varying vec3 model_position;    // in model space
+varying float mean;
+
+void main() {
+  position = vec3(gl_ModelViewMatrix * gl_Vertex);
+  normal = gl_NormalMatrix * gl_Normal;
+  model_position = gl_Vertex.xyz;
+  mean = curvature;
+  gl_Position = ftransform();
+}
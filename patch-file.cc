@@ -0,0 +1,174 @@
+#include "patch-file.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "byte-order.hh"
+#include "trigo-basis.hh"
+
+using ByteOrder::load;
+
+namespace {
+
+  const char MAGIC[8] = { 'B', 'Z', 'R', 'P', 'A', 'T', 'C', 'H' };
+  constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+  constexpr uint32_t VERSION = 1;
+  constexpr uint32_t TRIGONOMETRIC = 1;
+  constexpr size_t HEADER_SIZE = 32, ENTRY_SIZE = 24;
+  constexpr uint32_t MAX_DEGREE = 1 << 12; // guards the size computations against overflow
+
+  template <typename T>
+  void store(std::ostream &f, T x) {
+    f.write(reinterpret_cast<const char *>(&x), sizeof(T));
+  }
+
+  size_t pointCount(const uint32_t degree[2]) {
+    return (degree[0] + 1) * (degree[1] + 1);
+  }
+
+}
+
+namespace PatchFile {
+
+  bool isBinary(const std::string &filename) {
+    return filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".bzb") == 0;
+  }
+
+  bool readText(const std::string &filename, Patch &patch) {
+    size_t n, m;
+    try {
+      std::ifstream f(filename.c_str());
+      f.exceptions(std::ios::failbit | std::ios::badbit);
+      f >> n >> m;
+      patch.degree[0] = n++; patch.degree[1] = m++;
+      patch.control_points.resize(n * m);
+      for (size_t i = 0, index = 0; i < n; ++i)
+        for (size_t j = 0; j < m; ++j, ++index)
+          f >> patch.control_points[index][0] >> patch.control_points[index][1]
+            >> patch.control_points[index][2];
+    } catch(std::ifstream::failure &) {
+      return false;
+    }
+    return true;
+  }
+
+  bool writeText(const std::string &filename, const Patch &patch) {
+    try {
+      std::ofstream f(filename.c_str());
+      f.exceptions(std::ios::failbit | std::ios::badbit);
+      f << patch.degree[0] << ' ' << patch.degree[1] << std::endl;
+      for (const auto &p : patch.control_points)
+        f << p[0] << ' ' << p[1] << ' ' << p[2] << std::endl;
+    } catch(std::ifstream::failure &) {
+      return false;
+    }
+    return true;
+  }
+
+  bool write(const std::string &filename, const std::vector<Patch> &patches) {
+    try {
+      std::ofstream f(filename.c_str(), std::ios::binary);
+      f.exceptions(std::ios::failbit | std::ios::badbit);
+      f.write(MAGIC, sizeof(MAGIC));
+      store<uint32_t>(f, BYTE_ORDER_MARK);
+      store<uint32_t>(f, VERSION);
+      store<uint64_t>(f, patches.size());
+      store<uint64_t>(f, 0);
+      uint64_t offset = HEADER_SIZE + ENTRY_SIZE * patches.size();
+      for (const auto &patch : patches) {
+        store<uint32_t>(f, patch.degree[0]);
+        store<uint32_t>(f, patch.degree[1]);
+        store<uint32_t>(f, patch.trigonometric ? TRIGONOMETRIC : 0);
+        store<uint32_t>(f, 0);
+        store<uint64_t>(f, offset);
+        offset += patch.control_points.size() * 3 * sizeof(double);
+      }
+      for (const auto &patch : patches)
+        for (const auto &p : patch.control_points)
+          f.write(reinterpret_cast<const char *>(p.data()), 3 * sizeof(double));
+    } catch(std::ifstream::failure &) {
+      return false;
+    }
+    return true;
+  }
+
+  bool read(const std::string &filename, Patch &patch) {
+    Reader reader;
+    if (!reader.open(filename) || reader.size() == 0)
+      return false;
+    reader.read(0, patch);
+    return true;
+  }
+
+  bool Reader::open(const std::string &filename) {
+    close();
+    if (!file.open(filename))
+      return false;
+    const char *data = file.data();
+    if (file.size() < HEADER_SIZE || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0 ||
+        (load<uint32_t>(data + 8, false) != BYTE_ORDER_MARK &&
+         load<uint32_t>(data + 8, true) != BYTE_ORDER_MARK)) {
+      close();
+      return false;
+    }
+    swap = load<uint32_t>(data + 8, false) != BYTE_ORDER_MARK;
+    uint64_t count = load<uint64_t>(data + 16, swap);
+    if (load<uint32_t>(data + 12, swap) != VERSION ||
+        count > (file.size() - HEADER_SIZE) / ENTRY_SIZE) {
+      close();
+      return false;
+    }
+
+    // Check everything here, so that the accessors need not
+    size_t data_start = HEADER_SIZE + ENTRY_SIZE * count;
+    entries.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      const char *p = data + HEADER_SIZE + ENTRY_SIZE * i;
+      auto &e = entries[i];
+      e.degree[0] = load<uint32_t>(p, swap);
+      e.degree[1] = load<uint32_t>(p + 4, swap);
+      e.flags = load<uint32_t>(p + 8, swap);
+      e.offset = load<uint64_t>(p + 16, swap);
+      if (e.degree[0] > MAX_DEGREE || e.degree[1] > MAX_DEGREE || e.offset % 8 != 0 ||
+          e.offset < data_start || e.offset > file.size() ||
+          pointCount(e.degree) * 3 * sizeof(double) > file.size() - e.offset ||
+          ((e.flags & TRIGONOMETRIC) &&
+           !(trigosupports(e.degree[0]) && trigosupports(e.degree[1])))) {
+        close();
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void Reader::close() {
+    entries.clear();
+    file.close();
+  }
+
+  Reader::View Reader::view(size_t i) const {
+    const auto &e = entries[i];
+    const double *points = swap ? nullptr : reinterpret_cast<const double *>(file.data() + e.offset);
+    return { { e.degree[0], e.degree[1] }, (e.flags & TRIGONOMETRIC) != 0, points };
+  }
+
+  void Reader::read(size_t i, Patch &patch) const {
+    const auto &e = entries[i];
+    patch.degree[0] = e.degree[0];
+    patch.degree[1] = e.degree[1];
+    patch.trigonometric = e.flags & TRIGONOMETRIC;
+    size_t n = pointCount(e.degree);
+    patch.control_points.resize(n);
+    const char *p = file.data() + e.offset;
+    if (!swap) {
+      for (size_t j = 0; j < n; ++j, p += 3 * sizeof(double))
+        std::memcpy(patch.control_points[j].data(), p, 3 * sizeof(double));
+    } else {
+      for (size_t j = 0; j < n; ++j)
+        for (size_t k = 0; k < 3; ++k, p += sizeof(double))
+          patch.control_points[j][k] = load<double>(p, true);
+    }
+  }
+
+}
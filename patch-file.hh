@@ -0,0 +1,61 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped-file.hh"
+#include "patch.hh"
+
+// Bezier patches in text (.bzr, a single patch) or binary (.bzb, any number of patches) format.
+//
+// The text format is the degrees in u and v, then the control points, one per line.
+// The binary format is written in the byte order of the writer (offsets are in bytes):
+//   header:  char[8] "BZRPATCH", uint32 byte order mark 0x01020304, uint32 version,
+//            uint64 number of patches, uint64 reserved
+//   entries: for each patch uint32 degree[2], uint32 flags (1: trigonometric), uint32 reserved,
+//            uint64 offset of its control points
+//   data:    for each patch (degree[0] + 1) * (degree[1] + 1) control points as x, y, z doubles,
+//            in the order of Patch::control_points (so 8-byte aligned)
+namespace PatchFile {
+
+  // By the extension (.bzb)
+  bool isBinary(const std::string &filename);
+
+  bool readText(const std::string &filename, Patch &patch);
+  bool writeText(const std::string &filename, const Patch &patch);
+
+  bool write(const std::string &filename, const std::vector<Patch> &patches);
+  // Reads the first patch
+  bool read(const std::string &filename, Patch &patch);
+
+  // Random access to the patches of a mapped binary file. When the file has the byte order
+  // of the host, the control points are used in place, without parsing or copying.
+  // Files with trigonometric patches of degrees the table has no row for (see trigosupports)
+  // are rejected, so trigoinit should come first.
+  class Reader {
+  public:
+    struct View {
+      size_t degree[2];
+      bool trigonometric;
+      const double *points;     // x, y, z of each control point; nullptr if byte-swapped
+    };
+
+    bool open(const std::string &filename);
+    void close();
+    size_t size() const { return entries.size(); }
+    View view(size_t i) const;
+    void read(size_t i, Patch &patch) const;
+
+  private:
+    struct Entry {
+      uint32_t degree[2], flags;
+      uint64_t offset;
+    };
+    MappedFile file;
+    bool swap = false;
+    std::vector<Entry> entries;
+  };
+
+}
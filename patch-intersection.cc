@@ -0,0 +1,269 @@
+#include "patch-intersection.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+  constexpr size_t MAX_DEPTH = 24;          // subdivisions (in either direction)
+  constexpr double FLATNESS = 1.0e-3;       // relative to the size of the patch
+  constexpr size_t TRIGO_CELLS = 32;        // leaves in each direction for trigonometric patches
+  constexpr size_t TRIGO_SAMPLES = 3;       // per leaf in each direction
+  constexpr size_t MAX_ITERATIONS = 20;
+
+  // Parameter range of the ray inside the box, or false if it misses.
+  bool intersect(const Vector &min, const Vector &max, const Vector &from, const Vector &dir,
+                 double &t0, double &t1) {
+    t0 = 0.0;
+    t1 = std::numeric_limits<double>::max();
+    for (int i = 0; i < 3; ++i) {
+      if (dir[i] == 0.0) {
+        if (from[i] < min[i] || from[i] > max[i])
+          return false;
+        continue;
+      }
+      double a = (min[i] - from[i]) / dir[i], b = (max[i] - from[i]) / dir[i];
+      if (a > b)
+        std::swap(a, b);
+      t0 = std::max(t0, a);
+      t1 = std::min(t1, b);
+      if (t0 > t1)
+        return false;
+    }
+    return true;
+  }
+
+  // Maximal deviation of the net from the bilinear patch of its corners.
+  double deviation(const std::vector<Vector> &net, size_t n, size_t m) {
+    const auto &p00 = net[0], &p01 = net[m], &p10 = net[n*(m+1)], &p11 = net.back();
+    double result = 0.0;
+    for (size_t i = 0, index = 0; i <= n; ++i) {
+      double u = (double)i / n;
+      for (size_t j = 0; j <= m; ++j, ++index) {
+        double v = (double)j / m;
+        auto q = (p00 * (1 - v) + p01 * v) * (1 - u) + (p10 * (1 - v) + p11 * v) * u;
+        result = std::max(result, (net[index] - q).length());
+      }
+    }
+    return result;
+  }
+
+  // Control polygon length along u (k = 0) or v (k = 1).
+  double polygonLength(const std::vector<Vector> &net, size_t n, size_t m, size_t k) {
+    double result = 0.0;
+    for (size_t i = 0; i <= n; ++i)
+      for (size_t j = 0; j <= m; ++j) {
+        if (k == 0 && i < n)
+          result += (net[(i+1)*(m+1)+j] - net[i*(m+1)+j]).length();
+        if (k == 1 && j < m)
+          result += (net[i*(m+1)+j+1] - net[i*(m+1)+j]).length();
+      }
+    return result;
+  }
+
+  // Splits the net in halves by de Casteljau's algorithm, along u (k = 0) or v (k = 1).
+  void split(const std::vector<Vector> &net, size_t n, size_t m, size_t k,
+             std::vector<Vector> &first, std::vector<Vector> &second) {
+    first.resize(net.size());
+    second.resize(net.size());
+    size_t count = k == 0 ? m + 1 : n + 1, d = k == 0 ? n : m;
+    std::vector<Vector> tmp(d + 1);
+    for (size_t c = 0; c < count; ++c) {
+      auto index = [&](size_t i) { return k == 0 ? i * (m + 1) + c : c * (m + 1) + i; };
+      for (size_t i = 0; i <= d; ++i)
+        tmp[i] = net[index(i)];
+      for (size_t r = 0; r <= d; ++r) {
+        first[index(r)] = tmp[0];
+        second[index(d-r)] = tmp[d-r];
+        for (size_t i = 0; i < d - r; ++i)
+          tmp[i] = (tmp[i] + tmp[i+1]) / 2;
+      }
+    }
+  }
+
+}
+
+void PatchIntersector::build(const Patch &new_patch) {
+  patch = new_patch;
+  nodes.clear();
+  if (patch.control_points.empty())
+    return;
+
+  Vector min = patch.control_points[0], max = min;
+  for (const auto &p : patch.control_points) {
+    min.minimize(p);
+    max.maximize(p);
+  }
+  double size = (max - min).length();
+  flatness = size * FLATNESS;
+  epsilon = std::max(size, 1.0) * 1.0e-10;
+
+  if (patch.trigonometric)
+    build(0, 1, 0, 1);
+  else
+    build(patch.control_points, patch.degree[0], patch.degree[1], 0, 1, 0, 1, 0);
+}
+
+bool PatchIntersector::empty() const {
+  return nodes.empty();
+}
+
+int PatchIntersector::addNode(const Vector &min, const Vector &max,
+                              double u0, double u1, double v0, double v1) {
+  nodes.push_back({ min, max, { u0, u1 }, { v0, v1 }, -1, -1 });
+  return nodes.size() - 1;
+}
+
+int PatchIntersector::build(const std::vector<Vector> &net, size_t n, size_t m,
+                            double u0, double u1, double v0, double v1, size_t depth) {
+  Vector min = net[0], max = min;
+  for (const auto &p : net) {
+    min.minimize(p);
+    max.maximize(p);
+  }
+  int index = addNode(min, max, u0, u1, v0, v1);
+  if (depth == MAX_DEPTH || deviation(net, n, m) < flatness)
+    return index;
+
+  std::vector<Vector> first, second;
+  size_t k = polygonLength(net, n, m, 0) / n > polygonLength(net, n, m, 1) / m ? 0 : 1;
+  split(net, n, m, k, first, second);
+  int left, right;
+  if (k == 0) {
+    double mid = (u0 + u1) / 2;
+    left = build(first, n, m, u0, mid, v0, v1, depth + 1);
+    right = build(second, n, m, mid, u1, v0, v1, depth + 1);
+  } else {
+    double mid = (v0 + v1) / 2;
+    left = build(first, n, m, u0, u1, v0, mid, depth + 1);
+    right = build(second, n, m, u0, u1, mid, v1, depth + 1);
+  }
+  nodes[index].left = left;
+  nodes[index].right = right;
+  return index;
+}
+
+int PatchIntersector::build(double u0, double u1, double v0, double v1) {
+  double du = u1 - u0, dv = v1 - v0;
+  if (du * TRIGO_CELLS <= 1.0 + 1.0e-9 && dv * TRIGO_CELLS <= 1.0 + 1.0e-9) {
+    // Pad the box of the samples by twice the error bound of bilinear interpolation
+    Vector min, max;
+    double duu = 0.0, duv = 0.0, dvv = 0.0;
+    auto &der = EvaluationWorkspace::local().der;
+    for (size_t i = 0; i < TRIGO_SAMPLES; ++i)
+      for (size_t j = 0; j < TRIGO_SAMPLES; ++j) {
+        auto p = patch.evaluate(u0 + du * i / (TRIGO_SAMPLES - 1),
+                                v0 + dv * j / (TRIGO_SAMPLES - 1), 2, der);
+        if (i == 0 && j == 0)
+          min = max = p;
+        min.minimize(p);
+        max.maximize(p);
+        duu = std::max(duu, der[2][0].length());
+        duv = std::max(duv, der[1][1].length());
+        dvv = std::max(dvv, der[0][2].length());
+      }
+    double hu = du / (TRIGO_SAMPLES - 1), hv = dv / (TRIGO_SAMPLES - 1);
+    double pad = (duu * hu * hu + 2 * duv * hu * hv + dvv * hv * hv) / 4;
+    return addNode(min - Vector(pad, pad, pad), max + Vector(pad, pad, pad), u0, u1, v0, v1);
+  }
+
+  int index = addNode(Vector(), Vector(), u0, u1, v0, v1);
+  int left, right;
+  if (du >= dv) {
+    left = build(u0, (u0 + u1) / 2, v0, v1);
+    right = build((u0 + u1) / 2, u1, v0, v1);
+  } else {
+    left = build(u0, u1, v0, (v0 + v1) / 2);
+    right = build(u0, u1, (v0 + v1) / 2, v1);
+  }
+  auto &node = nodes[index];
+  node.left = left;
+  node.right = right;
+  node.min = nodes[left].min;
+  node.max = nodes[left].max;
+  node.min.minimize(nodes[right].min);
+  node.max.maximize(nodes[right].max);
+  return index;
+}
+
+bool PatchIntersector::intersect(const Vector &from, const Vector &dir, Hit &hit) const {
+  hit.t = std::numeric_limits<double>::max();
+  double t0, t1;
+  if (nodes.empty() || !::intersect(nodes[0].min, nodes[0].max, from, dir, t0, t1))
+    return false;
+
+  // Depth-first, the nearer child first; the stack holds entry distances
+  std::vector<std::pair<double, int>> stack;
+  stack.emplace_back(t0, 0);
+  while (!stack.empty()) {
+    auto entry = stack.back();
+    stack.pop_back();
+    if (entry.first > hit.t)
+      continue;
+    const auto &node = nodes[entry.second];
+    if (node.left < 0) {
+      if (::intersect(node.min, node.max, from, dir, t0, t1))
+        refine(node, from, dir, t0, t1, hit);
+      continue;
+    }
+    double l0, l1, r0, r1;
+    bool l = ::intersect(nodes[node.left].min, nodes[node.left].max, from, dir, l0, l1);
+    bool r = ::intersect(nodes[node.right].min, nodes[node.right].max, from, dir, r0, r1);
+    if (l && r) {
+      if (l0 < r0) {
+        stack.emplace_back(r0, node.right);
+        stack.emplace_back(l0, node.left);
+      } else {
+        stack.emplace_back(l0, node.left);
+        stack.emplace_back(r0, node.right);
+      }
+    } else if (l)
+      stack.emplace_back(l0, node.left);
+    else if (r)
+      stack.emplace_back(r0, node.right);
+  }
+  return hit.t < std::numeric_limits<double>::max();
+}
+
+// Solves S(u, v) = from + t * dir by Newton's method, starting from the middle of the leaf.
+// Updates `hit` when the solution is inside the leaf and nearer than the current one.
+void PatchIntersector::refine(const Node &node, const Vector &from, const Vector &dir,
+                              double t0, double t1, Hit &hit) const {
+  double u = (node.u[0] + node.u[1]) / 2, v = (node.v[0] + node.v[1]) / 2, t = (t0 + t1) / 2;
+  auto &der = EvaluationWorkspace::local().der;
+  bool converged = false;
+  for (size_t iteration = 0; iteration < MAX_ITERATIONS; ++iteration) {
+    auto p = patch.evaluate(u, v, 1, der);
+    auto r = from + dir * t - p;
+    if (r.length() < epsilon) {
+      converged = true;
+      break;
+    }
+    // Cramer's rule for [S_u S_v -dir] (du dv dt) = r
+    const auto &a = der[1][0], &b = der[0][1];
+    auto c = -dir;
+    double det = a | (b % c);
+    if (std::abs(det) < std::numeric_limits<double>::min())
+      break;
+    u = std::min(std::max(u + (r | (b % c)) / det, 0.0), 1.0);
+    v = std::min(std::max(v + (a | (r % c)) / det, 0.0), 1.0);
+    t += (a | (b % r)) / det;
+  }
+  if (!converged || t < 0.0 || t >= hit.t)
+    return;
+
+  // Accept only solutions inside the leaf (with some tolerance), as others are found elsewhere
+  double tu = (node.u[1] - node.u[0]) * 1.0e-3, tv = (node.v[1] - node.v[0]) * 1.0e-3;
+  if (u < node.u[0] - tu || u > node.u[1] + tu || v < node.v[0] - tv || v > node.v[1] + tv)
+    return;
+
+  hit.u = u;
+  hit.v = v;
+  hit.t = t;
+  hit.point = patch.evaluate(u, v, 1, der);
+  hit.normal = der[0][1] % der[1][0];
+  double length = hit.normal.length();
+  if (length != 0.0)
+    hit.normal /= length;
+}
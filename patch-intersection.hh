@@ -0,0 +1,46 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <vector>
+
+#include "patch.hh"
+
+// Exact ray-patch intersection.
+// The patch is covered by a hierarchy of bounding boxes over parameter rectangles;
+// the first hit is found by Newton iteration in the leaves, nearest leaves first.
+// Bernstein patches are subdivided until their control nets are flat, so the boxes of the
+// sub-nets are conservative. Trigonometric patches have no subdivision here, so their boxes
+// come from samples padded by the sampled second derivatives.
+class PatchIntersector {
+public:
+  struct Hit {
+    double u, v;
+    double t;                   // distance along the ray (in units of `dir`)
+    Vector point, normal;
+  };
+
+  void build(const Patch &patch);
+  bool empty() const;
+
+  // Returns false when the ray misses the patch.
+  bool intersect(const Vector &from, const Vector &dir, Hit &hit) const;
+
+private:
+  struct Node {
+    Vector min, max;
+    double u[2], v[2];          // parameter rectangle
+    int left, right;            // children (-1 for leaves)
+  };
+
+  int build(const std::vector<Vector> &net, size_t n, size_t m,
+            double u0, double u1, double v0, double v1, size_t depth);
+  int build(double u0, double u1, double v0, double v1);
+  int addNode(const Vector &min, const Vector &max,
+              double u0, double u1, double v0, double v1);
+  void refine(const Node &node, const Vector &from, const Vector &dir,
+              double t0, double t1, Hit &hit) const;
+
+  Patch patch;
+  std::vector<Node> nodes;
+  double flatness, epsilon;
+};
@@ -0,0 +1,103 @@
+#include "patch-projection.hh"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+  constexpr size_t MAX_ITERATIONS = 10;
+  constexpr double EPSILON = 1.0e-12;       // in parameter space
+
+  double clamp(double x) {
+    return std::min(std::max(x, 0.0), 1.0);
+  }
+
+}
+
+void PatchProjector::build(const Patch &new_patch, size_t new_resolution) {
+  patch = new_patch;
+  resolution = new_resolution;
+  std::vector<Vector> samples(resolution * resolution);
+  int n = samples.size();
+#pragma omp parallel for
+  for (int k = 0; k < n; ++k) {
+    size_t i = k / resolution, j = k % resolution;
+    samples[k] = patch.evaluate((double)i / (resolution - 1), (double)j / (resolution - 1));
+  }
+  index.build(samples);
+}
+
+bool PatchProjector::empty() const {
+  return index.empty();
+}
+
+PatchProjector::Result PatchProjector::project(const Vector &p) const {
+  int k = index.nearest(p);
+  double u = (double)(k / resolution) / (resolution - 1);
+  double v = (double)(k % resolution) / (resolution - 1);
+
+  // Minimize |S(u, v) - p|^2 / 2 inside the domain.
+  // On the boundary, coordinates that would leave it are kept fixed.
+  auto &der = EvaluationWorkspace::local().der;
+  auto r = patch.evaluate(u, v, 2, der) - p;
+  for (size_t iteration = 0; iteration < MAX_ITERATIONS; ++iteration) {
+    const auto &su = der[1][0], &sv = der[0][1];
+    double gu = su | r, gv = sv | r;
+    double a = (su | su) + (der[2][0] | r);
+    double b = (su | sv) + (der[1][1] | r);
+    double c = (sv | sv) + (der[0][2] | r);
+    if (a <= 0.0 || a * c - b * b <= 0.0) {
+      // Not convex here: fall back to Gauss-Newton
+      a = su | su; b = su | sv; c = sv | sv;
+    }
+    bool fix_u = (u <= 0.0 && gu > 0.0) || (u >= 1.0 && gu < 0.0);
+    bool fix_v = (v <= 0.0 && gv > 0.0) || (v >= 1.0 && gv < 0.0);
+    double du = 0.0, dv = 0.0;
+    if (fix_u && fix_v)
+      break;
+    if (fix_u)
+      dv = c > 0.0 ? -gv / c : 0.0;
+    else if (fix_v)
+      du = a > 0.0 ? -gu / a : 0.0;
+    else {
+      double det = a * c - b * b;
+      if (det <= 0.0)
+        break;
+      du = -(c * gu - b * gv) / det;
+      dv = -(a * gv - b * gu) / det;
+    }
+
+    // Halve the step until the distance decreases
+    double u1, v1, d2 = r.sqrnorm();
+    Vector r1;
+    do {
+      u1 = clamp(u + du);
+      v1 = clamp(v + dv);
+      r1 = patch.evaluate(u1, v1, 2, der) - p;
+      du /= 2; dv /= 2;
+    } while (r1.sqrnorm() > d2 && std::abs(du) + std::abs(dv) > EPSILON);
+    bool converged = std::abs(u1 - u) + std::abs(v1 - v) < EPSILON;
+    u = u1; v = v1; r = r1;
+    if (converged)
+      break;
+  }
+
+  Result result;
+  result.u = u;
+  result.v = v;
+  result.foot = patch.evaluate(u, v, 1, der);
+  auto d = p - result.foot;
+  result.distance = d.length();
+  if ((d | (der[0][1] % der[1][0])) < 0.0)
+    result.distance = -result.distance;
+  return result;
+}
+
+void PatchProjector::project(const std::vector<Vector> &points,
+                             std::vector<Result> &results) const {
+  results.resize(points.size());
+  int n = points.size();
+#pragma omp parallel for
+  for (int i = 0; i < n; ++i)
+    results[i] = project(points[i]);
+}
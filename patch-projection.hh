@@ -0,0 +1,30 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <vector>
+
+#include "patch.hh"
+#include "point-index.hh"
+
+// Closest point projection (point inversion) onto a patch.
+// The initial guess is the nearest sample of a parameter grid, which is refined by
+// Newton iteration on the squared distance, using second derivatives.
+class PatchProjector {
+public:
+  struct Result {
+    double u, v;
+    double distance;            // signed: positive on the side of the normal
+    Vector foot;
+  };
+
+  void build(const Patch &patch, size_t resolution = 64);
+  bool empty() const;
+
+  Result project(const Vector &p) const;
+  void project(const std::vector<Vector> &points, std::vector<Result> &results) const;
+
+private:
+  Patch patch;
+  size_t resolution;
+  PointIndex index;             // over the grid samples
+};
@@ -0,0 +1,318 @@
+#include "patch.hh"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <utility>
+
+#include "bernstein.hh"
+#include "trigo-basis.hh"
+
+namespace {
+
+  // Degrees 1..MAX_DEGREE with derivatives up to MAX_DERIVATIVES use fixed-size kernels
+  constexpr size_t MAX_DEGREE = 10;
+  constexpr size_t MAX_DERIVATIVES = 2;
+
+  std::atomic<size_t> allocation_count(0);
+
+  // Ensures the capacity of the buffer, counting reallocations
+  template <typename T>
+  void grow(std::vector<T> &buffer, size_t size) {
+    if (buffer.capacity() < size) {
+      allocation_count++;
+      buffer.reserve(size);
+    }
+  }
+
+  // Ensures at least `rows` rows, each with the given capacity (rows are never removed,
+  // as that would free their buffers)
+  template <typename T>
+  void grow(std::vector<std::vector<T>> &buffer, size_t rows, size_t columns) {
+    if (buffer.size() < rows) {
+      grow(buffer, rows);
+      buffer.resize(rows);
+    }
+    for (size_t i = 0; i < rows; ++i)
+      grow(buffer[i], columns);
+  }
+
+  template <typename T>
+  using BasisKernel = void (*)(T, std::vector<std::vector<T>> &);
+  using TensorKernel = void (*)(const Vector *, double, double, size_t,
+                                std::vector<std::vector<Vector>> &);
+
+  template <size_t N, size_t D, typename T>
+  void basisKernel(T u, std::vector<std::vector<T>> &coeffs) {
+    T c[D+1][N+1];
+    bernstein<N, D>(u, c);
+    grow(coeffs, D + 1, N + 1);
+    for (size_t d = 0; d <= D; ++d)
+      coeffs[d].assign(c[d], c[d] + N + 1);
+  }
+
+  template <size_t N, size_t M, size_t D>
+  void tensorKernel(const Vector *points, double u, double v, size_t derivatives,
+                    std::vector<std::vector<Vector>> &der) {
+    static_assert(sizeof(Vector) == 3 * sizeof(double), "Vector is not packed");
+    double d[D+1][D+1][3];
+    bezierTensor<N, M, D>(points[0].data(), u, v, d);
+    grow(der, derivatives + 1, derivatives + 1);
+    for (size_t i = 0; i <= derivatives; ++i) {
+      der[i].resize(derivatives + 1);
+      for (size_t j = 0; j <= derivatives; ++j)
+        der[i][j] = i + j <= D ? Vector(d[i][j][0], d[i][j][1], d[i][j][2]) : Vector(0, 0, 0);
+    }
+  }
+
+  // Tables indexed by [derivatives][degree - 1] and [derivatives][(n - 1) * MAX_DEGREE + m - 1]
+
+  template <size_t D, typename T, size_t... I>
+  std::array<BasisKernel<T>, sizeof...(I)> basisKernels(std::index_sequence<I...>) {
+    return { { &basisKernel<I + 1, D, T>... } };
+  }
+
+  template <size_t D, size_t... I>
+  std::array<TensorKernel, sizeof...(I)> tensorKernels(std::index_sequence<I...>) {
+    return { { &tensorKernel<I / MAX_DEGREE + 1, I % MAX_DEGREE + 1, D>... } };
+  }
+
+  template <typename T>
+  const std::array<BasisKernel<T>, MAX_DEGREE> basis_kernels[MAX_DERIVATIVES+1] = {
+    basisKernels<0, T>(std::make_index_sequence<MAX_DEGREE>()),
+    basisKernels<1, T>(std::make_index_sequence<MAX_DEGREE>()),
+    basisKernels<2, T>(std::make_index_sequence<MAX_DEGREE>())
+  };
+
+  const std::array<TensorKernel, MAX_DEGREE * MAX_DEGREE> tensor_kernels[] = {
+    tensorKernels<0>(std::make_index_sequence<MAX_DEGREE * MAX_DEGREE>()),
+    tensorKernels<1>(std::make_index_sequence<MAX_DEGREE * MAX_DEGREE>()),
+    tensorKernels<2>(std::make_index_sequence<MAX_DEGREE * MAX_DEGREE>())
+  };
+
+  bool specialized(size_t degree, size_t derivatives) {
+    return degree >= 1 && degree <= MAX_DEGREE && derivatives <= MAX_DERIVATIVES;
+  }
+
+}
+
+void bernstein(size_t n, double u, std::vector<double> &coeff) {
+  coeff.clear(); coeff.reserve(n + 1);
+  coeff.push_back(1.0);
+  double u1 = 1.0 - u;
+  for (size_t j = 1; j <= n; ++j) {
+    double saved = 0.0;
+    for (size_t k = 0; k < j; ++k) {
+      double tmp = coeff[k];
+      coeff[k] = saved + tmp * u1;
+      saved = tmp * u;
+    }
+    coeff.push_back(saved);
+  }
+}
+
+template <typename T>
+void bernstein(size_t n, T u, size_t derivatives, std::vector<std::vector<T>> &coeffs) {
+  if (specialized(n, derivatives)) {
+    basis_kernels<T>[derivatives][n-1](u, coeffs);
+    return;
+  }
+
+  // Same as bernstein<N, D>, with run-time bounds
+  grow(coeffs, derivatives + 1, n + 1);
+  for (size_t d = 0; d <= derivatives; ++d)
+    coeffs[d].resize(n + 1);
+  auto &b = coeffs[0];
+  b[0] = 1;
+  T u1 = 1 - u;
+  for (size_t j = 1; j <= n; ++j) {
+    if (n - j + 1 <= derivatives)
+      std::copy_n(b.begin(), j, coeffs[n-j+1].begin());
+    T saved = 0;
+    for (size_t k = 0; k < j; ++k) {
+      T tmp = b[k];
+      b[k] = saved + tmp * u1;
+      saved = tmp * u;
+    }
+    b[j] = saved;
+  }
+  for (size_t d = 1; d <= derivatives; ++d) {
+    auto &a = coeffs[d];
+    if (d > n) {
+      std::fill(a.begin(), a.end(), T(0));
+      continue;
+    }
+    for (size_t m = n - d; m < n; ++m) {
+      a[m+1] = a[m] * (m + 1);
+      for (size_t i = m; i > 0; --i)
+        a[i] = (a[i-1] - a[i]) * (m + 1);
+      a[0] *= -(T)(m + 1);
+    }
+  }
+}
+
+template void bernstein(size_t, float, size_t, std::vector<std::vector<float>> &);
+template void bernstein(size_t, double, size_t, std::vector<std::vector<double>> &);
+
+void basisFunctions(bool trigonometric, size_t degree, double t, size_t derivatives,
+                    std::vector<std::vector<double>> &coeffs) {
+  if (!trigonometric) {
+    bernstein(degree, t, derivatives, coeffs);
+    return;
+  }
+  grow(coeffs, derivatives + 1, degree + 1);
+  trigobasis(degree, t, derivatives, coeffs);
+  // The table has derivatives by the angle pi/2 * t
+  for (size_t i = 1; i <= derivatives; ++i) {
+    double s = std::pow(M_PI / 2, i);
+    for (auto &c : coeffs[i])
+      c *= s;
+  }
+}
+
+void Patch::basis(size_t k, double t, size_t derivatives,
+                  std::vector<std::vector<double>> &coeffs) const {
+  basisFunctions(trigonometric, degree[k], t, derivatives, coeffs);
+}
+
+Vector Patch::evaluate(double u, double v, size_t derivatives,
+                       std::vector<std::vector<Vector>> &der) const {
+  size_t n = degree[0], m = degree[1];
+  if (!trigonometric && specialized(n, derivatives) && specialized(m, derivatives)) {
+    tensor_kernels[derivatives][(n-1)*MAX_DEGREE+m-1](control_points.data(), u, v,
+                                                      derivatives, der);
+    return der[0][0];
+  }
+
+  auto &ws = EvaluationWorkspace::local();
+  auto &coeff_u = ws.coeffs[0], &coeff_v = ws.coeffs[1];
+  basis(0, u, derivatives, coeff_u);
+  basis(1, v, derivatives, coeff_v);
+
+  // Contract with the v-basis row by row, then with the u-basis
+  grow(der, derivatives + 1, derivatives + 1);
+  for (size_t i = 0; i <= derivatives; ++i)
+    der[i].assign(derivatives + 1, Vector(0, 0, 0));
+  grow(ws.row, derivatives + 1);
+  auto &row = ws.row;
+  row.resize(derivatives + 1);
+  for (size_t k = 0, index = 0; k <= n; ++k, index += m + 1) {
+    for (size_t j = 0; j <= derivatives; ++j) {
+      row[j] = Vector(0, 0, 0);
+      for (size_t l = 0; l <= m; ++l)
+        row[j] += control_points[index+l] * coeff_v[j][l];
+    }
+    for (size_t i = 0; i <= derivatives; ++i)
+      for (size_t j = 0; i + j <= derivatives; ++j)
+        der[i][j] += row[j] * coeff_u[i][k];
+  }
+  return der[0][0];
+}
+
+Vector Patch::evaluate(double u, double v) const {
+  return evaluate(u, v, 0, EvaluationWorkspace::local().point);
+}
+
+template <typename T>
+void Patch::evaluateGrid(size_t resolution, std::vector<Vector> &points) const {
+  size_t n = degree[0], m = degree[1];
+
+  // Relative to the center of the net (the basis sums to 1), for the error bound
+  Vector min = control_points[0], max = min;
+  for (const auto &p : control_points) {
+    min.minimize(p);
+    max.maximize(p);
+  }
+  Vector center = (min + max) / 2;
+  std::vector<T> local(control_points.size() * 3);
+  for (size_t i = 0; i < control_points.size(); ++i)
+    for (size_t c = 0; c < 3; ++c)
+      local[3*i+c] = control_points[i][c] - center[c];
+
+  // Basis values on the grid, bv transposed so that rows are swept contiguously
+  std::vector<T> bu(resolution * (n + 1)), bv((m + 1) * resolution);
+  std::vector<std::vector<double>> coeffs;
+  for (size_t i = 0; i < resolution; ++i) {
+    double t = (double)i / (resolution - 1);
+    basis(0, t, 0, coeffs);
+    for (size_t k = 0; k <= n; ++k)
+      bu[i*(n+1)+k] = coeffs[0][k];
+    basis(1, t, 0, coeffs);
+    for (size_t l = 0; l <= m; ++l)
+      bv[l*resolution+i] = coeffs[0][l];
+  }
+
+  // Each row: contract with the u-basis, then accumulate the v-basis over the whole row
+  points.resize(resolution * resolution);
+  int rows = resolution;
+#pragma omp parallel for
+  for (int i = 0; i < rows; ++i) {
+    std::vector<T> q((m + 1) * 3, 0), xyz(resolution * 3, 0);
+    for (size_t k = 0, index = 0; k <= n; ++k)
+      for (size_t l = 0; l <= m; ++l, ++index)
+        for (size_t c = 0; c < 3; ++c)
+          q[l*3+c] += bu[i*(n+1)+k] * local[index*3+c];
+    T *x = xyz.data(), *y = x + resolution, *z = y + resolution;
+    for (size_t l = 0; l <= m; ++l) {
+      const T *b = &bv[l*resolution];
+      T qx = q[l*3], qy = q[l*3+1], qz = q[l*3+2];
+      for (size_t j = 0; j < resolution; ++j) {
+        x[j] += b[j] * qx;
+        y[j] += b[j] * qy;
+        z[j] += b[j] * qz;
+      }
+    }
+    for (size_t j = 0; j < resolution; ++j)
+      points[i*resolution+j] = center + Vector(x[j], y[j], z[j]);
+  }
+}
+
+template void Patch::evaluateGrid<float>(size_t, std::vector<Vector> &) const;
+template void Patch::evaluateGrid<double>(size_t, std::vector<Vector> &) const;
+
+EvaluationWorkspace &EvaluationWorkspace::local() {
+  thread_local EvaluationWorkspace workspace;
+  return workspace;
+}
+
+size_t EvaluationWorkspace::allocations() {
+  return allocation_count;
+}
+
+void EvaluationWorkspace::grow(std::vector<Vector> &buffer, size_t size) {
+  ::grow(buffer, size);
+  if (buffer.size() < size)
+    buffer.resize(size);
+}
+
+void Patch::elevateU() {
+  std::vector<Vector> tmp;
+  for (size_t j = 0; j <= degree[1]; ++j)
+    tmp.push_back(control_points[j]);
+  for (size_t i = 1, index = degree[1] + 1; i <= degree[0]; ++i) {
+    double ratio = (double)i / (degree[0] + 1);
+    for (size_t j = 0; j <= degree[1]; ++j, ++index)
+      tmp.push_back(control_points[index-degree[1]-1] * ratio +
+                    control_points[index] * (1 - ratio));
+  }
+  for (size_t j = 0, base = degree[0] * (degree[1] + 1); j <= degree[1]; ++j)
+    tmp.push_back(control_points[base+j]);
+  control_points = tmp;
+  degree[0]++;
+}
+
+void Patch::elevateV() {
+  std::vector<Vector> tmp;
+  for (size_t i = 0, index = 0; i <= degree[0]; ++i) {
+    tmp.push_back(control_points[index++]);
+    for (size_t j = 1; j <= degree[1]; ++j, ++index) {
+      double ratio = (double)j / (degree[1] + 1);
+      tmp.push_back(control_points[index-1] * ratio +
+                    control_points[index] * (1 - ratio));
+    }
+    tmp.push_back(control_points[index-1]);
+  }
+  control_points = tmp;
+  degree[1]++;
+}
@@ -0,0 +1,60 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <vector>
+
+#include "mesh.hh"
+
+// Tensor product surface with Bernstein or trigonometric basis functions.
+struct Patch {
+  size_t degree[2];
+  std::vector<Vector> control_points; // v varies fastest
+  bool trigonometric = false;
+
+  // der[i][j] is the derivative i times by u and j times by v (for i + j <= derivatives);
+  // der is only grown, so reusing it (e.g. EvaluationWorkspace::der) avoids allocation
+  Vector evaluate(double u, double v, size_t derivatives,
+                  std::vector<std::vector<Vector>> &der) const;
+  Vector evaluate(double u, double v) const;
+  // Points of the resolution x resolution grid of parameters (u major), in parallel,
+  // computed with scalar type T (float or double) relative to the center c of the net.
+  // The contraction sweeps whole rows, so it is vectorized, with twice the width in float.
+  // In single precision the error is below (4 (n + m) + 8) * 2^-24 * max |P_i - c|
+  // (coordinatewise), the usual bound of nonnegative sums (both bases are nonnegative),
+  // which holds with a margin of 5-30x on random nets. For degrees 3, 5 and 10 in both
+  // directions this is 1.9e-6, 2.9e-6 and 5.2e-6 times the size of the net: fine for
+  // display (a pixel of a 4K screen is 2.6e-4 of its width), but analysis and fitting
+  // should stay in double precision.
+  template <typename T>
+  void evaluateGrid(size_t resolution, std::vector<Vector> &points) const;
+  // Basis functions (and their derivatives) in the u (k = 0) or v (k = 1) direction;
+  // coeffs[d] is the d-th derivative (coeffs may have more rows, as it is only grown)
+  void basis(size_t k, double t, size_t derivatives,
+             std::vector<std::vector<double>> &coeffs) const;
+  void elevateU();
+  void elevateV();
+};
+
+// Scratch buffers of the evaluation, reused across calls, so that evaluation does not
+// allocate once they have grown large enough. Each thread has its own, see local().
+struct EvaluationWorkspace {
+  std::vector<std::vector<double>> coeffs[2];
+  std::vector<Vector> row;
+  std::vector<std::vector<Vector>> der;   // free for the callers of Patch::evaluate
+  std::vector<std::vector<Vector>> point; // used by Patch::evaluate(u, v)
+  std::vector<Vector> curve;              // free for the callers of Curve::evaluate
+
+  static EvaluationWorkspace &local();
+  // Number of times evaluation buffers had to grow, summed over all threads
+  static size_t allocations();
+  // Makes the buffer at least `size` long (never shorter), counted in allocations()
+  static void grow(std::vector<Vector> &buffer, size_t size);
+};
+
+void bernstein(size_t n, double u, std::vector<double> &coeff);
+// For T = float or double
+template <typename T>
+void bernstein(size_t n, T u, size_t derivatives, std::vector<std::vector<T>> &coeffs);
+// Bernstein or trigonometric basis functions of the given degree, as in Patch::basis
+void basisFunctions(bool trigonometric, size_t degree, double t, size_t derivatives,
+                    std::vector<std::vector<double>> &coeffs);
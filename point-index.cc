@@ -0,0 +1,186 @@
+#include "point-index.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+  constexpr size_t LEAF_SIZE = 8;
+
+  // Parameter range of the ray inside the box, or false if it misses.
+  bool intersect(const Vector &min, const Vector &max, const Vector &from, const Vector &dir,
+                 double &t0, double &t1) {
+    t0 = 0.0;
+    t1 = std::numeric_limits<double>::max();
+    for (int i = 0; i < 3; ++i) {
+      if (dir[i] == 0.0) {
+        if (from[i] < min[i] || from[i] > max[i])
+          return false;
+        continue;
+      }
+      double a = (min[i] - from[i]) / dir[i], b = (max[i] - from[i]) / dir[i];
+      if (a > b)
+        std::swap(a, b);
+      t0 = std::max(t0, a);
+      t1 = std::min(t1, b);
+      if (t0 > t1)
+        return false;
+    }
+    return true;
+  }
+
+  double boxDistance2(const Vector &min, const Vector &max, const Vector &p) {
+    double result = 0.0;
+    for (int i = 0; i < 3; ++i) {
+      double d = std::max(std::max(min[i] - p[i], p[i] - max[i]), 0.0);
+      result += d * d;
+    }
+    return result;
+  }
+
+}
+
+void PointIndex::build(const std::vector<Vector> &new_points) {
+  points = new_points;
+  order.resize(points.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  leaf.resize(points.size());
+  nodes.clear();
+  if (!points.empty())
+    build(-1, 0, points.size());
+}
+
+int PointIndex::build(int parent, size_t begin, size_t end) {
+  int index = nodes.size();
+  nodes.push_back({ Vector(), Vector(), parent, -1, -1, begin, end });
+  if (end - begin <= LEAF_SIZE) {
+    for (size_t i = begin; i < end; ++i)
+      leaf[order[i]] = index;
+    fit(index);
+    return index;
+  }
+
+  // Median split along the longest axis of the bounding box
+  Vector min = points[order[begin]], max = min;
+  for (size_t i = begin + 1; i < end; ++i) {
+    min.minimize(points[order[i]]);
+    max.maximize(points[order[i]]);
+  }
+  auto size = max - min;
+  int axis = size[0] > size[1] ? (size[0] > size[2] ? 0 : 2) : (size[1] > size[2] ? 1 : 2);
+  size_t mid = (begin + end) / 2;
+  std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                   [&](size_t a, size_t b) { return points[a][axis] < points[b][axis]; });
+
+  int left = build(index, begin, mid);
+  int right = build(index, mid, end);
+  nodes[index].left = left;
+  nodes[index].right = right;
+  fit(index);
+  return index;
+}
+
+void PointIndex::fit(int index) {
+  auto &node = nodes[index];
+  if (node.left < 0) {
+    node.min = node.max = points[order[node.begin]];
+    for (size_t i = node.begin + 1; i < node.end; ++i) {
+      node.min.minimize(points[order[i]]);
+      node.max.maximize(points[order[i]]);
+    }
+  } else {
+    node.min = nodes[node.left].min;
+    node.max = nodes[node.left].max;
+    node.min.minimize(nodes[node.right].min);
+    node.max.maximize(nodes[node.right].max);
+  }
+}
+
+void PointIndex::update(size_t i, const Vector &p) {
+  points[i] = p;
+  for (int node = leaf[i]; node >= 0; node = nodes[node].parent)
+    fit(node);
+}
+
+bool PointIndex::empty() const {
+  return nodes.empty();
+}
+
+int PointIndex::pick(const Vector &from, const Vector &dir, double radius, double slope) const {
+  int best = -1;
+  double best_t = std::numeric_limits<double>::max();
+  if (nodes.empty())
+    return best;
+
+  std::vector<int> stack = { 0 };
+  while (!stack.empty()) {
+    const auto &node = nodes[stack.back()];
+    stack.pop_back();
+
+    // The cone is widest at the farthest corner of the box
+    Vector farthest;
+    for (int i = 0; i < 3; ++i)
+      farthest[i] = std::abs(node.min[i] - from[i]) > std::abs(node.max[i] - from[i])
+        ? node.min[i] : node.max[i];
+    double r = radius + slope * (farthest - from).norm();
+    Vector extent(r, r, r);
+    double t0, t1;
+    if (!intersect(node.min - extent, node.max + extent, from, dir, t0, t1) || t0 > best_t)
+      continue;
+
+    if (node.left < 0) {
+      for (size_t j = node.begin; j < node.end; ++j) {
+        auto q = points[order[j]] - from;
+        double t = q | dir;
+        if (t < 0.0 || t >= best_t)
+          continue;
+        double r = radius + slope * t;
+        if (q.sqrnorm() - t * t <= r * r) {
+          best = order[j];
+          best_t = t;
+        }
+      }
+    } else {
+      // Visit the nearer child first
+      const auto &left = nodes[node.left], &right = nodes[node.right];
+      bool left_first = ((left.min + left.max - from * 2.0) | dir) <
+        ((right.min + right.max - from * 2.0) | dir);
+      stack.push_back(left_first ? node.right : node.left);
+      stack.push_back(left_first ? node.left : node.right);
+    }
+  }
+  return best;
+}
+
+int PointIndex::nearest(const Vector &p) const {
+  int best = -1;
+  double best_d2 = std::numeric_limits<double>::max();
+  if (nodes.empty())
+    return best;
+
+  std::vector<int> stack = { 0 };
+  while (!stack.empty()) {
+    const auto &node = nodes[stack.back()];
+    stack.pop_back();
+    if (boxDistance2(node.min, node.max, p) >= best_d2)
+      continue;
+
+    if (node.left < 0) {
+      for (size_t j = node.begin; j < node.end; ++j) {
+        double d2 = (points[order[j]] - p).sqrnorm();
+        if (d2 < best_d2) {
+          best = order[j];
+          best_d2 = d2;
+        }
+      }
+    } else {
+      const auto &left = nodes[node.left], &right = nodes[node.right];
+      bool left_first = boxDistance2(left.min, left.max, p) < boxDistance2(right.min, right.max, p);
+      stack.push_back(left_first ? node.right : node.left);
+      stack.push_back(left_first ? node.left : node.right);
+    }
+  }
+  return best;
+}
@@ -0,0 +1,40 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <vector>
+
+#include "mesh.hh"
+
+// Bounding volume hierarchy over a point set, for picking and nearest point queries.
+// Moving a point refits only the boxes above it, so the index can follow interactive edits.
+class PointIndex {
+public:
+  void build(const std::vector<Vector> &points);
+  void update(size_t i, const Vector &p);
+  bool empty() const;
+
+  // Returns the point closest to `from` along the ray (`dir` is normalized),
+  // within a cone around it of radius `radius + slope * t` at distance t, or -1 if none.
+  // For picking, `radius` is the tolerance with orthographic projection,
+  // and `slope` is the tolerance with perspective projection.
+  int pick(const Vector &from, const Vector &dir, double radius, double slope) const;
+
+  // Returns the point closest to `p`, or -1 if the index is empty.
+  int nearest(const Vector &p) const;
+
+private:
+  struct Node {
+    Vector min, max;
+    int parent;
+    int left, right;            // children (-1 for leaves)
+    size_t begin, end;          // range in `order`
+  };
+
+  int build(int parent, size_t begin, size_t end);
+  void fit(int node);
+
+  std::vector<Vector> points;
+  std::vector<size_t> order;    // point indices in leaf order
+  std::vector<int> leaf;        // the leaf containing each point
+  std::vector<Node> nodes;
+};
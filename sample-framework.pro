@@ -4,10 +4,23 @@ TARGET = sample-framework
 CONFIG += c++14 qt opengl debug
 QT += gui widgets opengl xml
 
-HEADERS = MyWindow.h MyViewer.h MyViewer.hpp trigo-basis.hh
-SOURCES = MyWindow.cpp MyViewer.cpp main.cpp trigo-basis.cc
+HEADERS = MyWindow.h MyViewer.h MyViewer.hpp trigo-basis.hh \
+          mesh.hh geometry.hh curvature.hh statistics.hh fairing.hh \
+          point-index.hh bernstein.hh patch.hh patch-intersection.hh \
+          patch-projection.hh fitting.hh contours.hh tessellation.hh \
+          trace.hh mapped-file.hh byte-order.hh mesh-loader.hh \
+          patch-file.hh mesh-export.hh MeshShader.h OffscreenRenderer.h \
+          curve.hh tessellation-cache.hh incremental-tessellation.hh
+SOURCES = MyWindow.cpp MyViewer.cpp main.cpp trigo-basis.cc \
+          geometry.cc curvature.cc statistics.cc fairing.cc \
+          point-index.cc patch.cc patch-intersection.cc \
+          patch-projection.cc fitting.cc contours.cc tessellation.cc \
+          trace.cc mapped-file.cc mesh-loader.cc \
+          patch-file.cc mesh-export.cc MeshShader.cpp OffscreenRenderer.cpp \
+          curve.cc tessellation-cache.cc incremental-tessellation.cc
 
 INCLUDEPATH += /usr/include/eigen3
-LIBS *= -lQGLViewer-qt5 -L/usr/lib/OpenMesh -lOpenMeshCore -lGL -lGLU
+QMAKE_CXXFLAGS += -fopenmp
+LIBS *= -lQGLViewer-qt5 -L/usr/lib/OpenMesh -lOpenMeshCore -lGL -lGLU -fopenmp
 
 RESOURCES = sample-framework.qrc
@@ -0,0 +1,210 @@
+#include "statistics.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+Statistics::Statistics()
+  : count(0), min_value(0.0), max_value(0.0), min_count(0), max_count(0),
+    range_min(0.0), range_max(0.0), bins(BINS, 0), blocks(BLOCKS, 0) {
+}
+
+void Statistics::build(const std::vector<double> &new_values) {
+  values = new_values;
+  bins.assign(BINS, 0);
+  blocks.assign(BLOCKS, 0);
+
+  int n = values.size();
+  double lo = std::numeric_limits<double>::max(), hi = std::numeric_limits<double>::lowest();
+  size_t finite = 0;
+#pragma omp parallel for reduction(min:lo) reduction(max:hi) reduction(+:finite)
+  for (int i = 0; i < n; ++i)
+    if (std::isfinite(values[i])) {
+      lo = std::min(lo, values[i]);
+      hi = std::max(hi, values[i]);
+      finite++;
+    }
+  count = finite;
+  if (count == 0) {
+    min_value = max_value = range_min = range_max = 0.0;
+    min_count = max_count = 0;
+    return;
+  }
+  min_value = range_min = lo;
+  max_value = range_max = hi;
+
+  size_t at_min = 0, at_max = 0;
+#pragma omp parallel reduction(+:at_min, at_max)
+  {
+    std::vector<uint32_t> local(BINS, 0);
+#pragma omp for nowait
+    for (int i = 0; i < n; ++i)
+      if (std::isfinite(values[i])) {
+        local[bin(values[i])]++;
+        at_min += values[i] == lo;
+        at_max += values[i] == hi;
+      }
+#pragma omp critical
+    for (size_t i = 0; i < BINS; ++i)
+      bins[i] += local[i];
+  }
+  min_count = at_min;
+  max_count = at_max;
+  for (size_t i = 0; i < BINS; ++i)
+    blocks[i / BINS_PER_BLOCK] += bins[i];
+}
+
+void Statistics::update(size_t index, double value) {
+  double old = values[index];
+  values[index] = value;
+  if (std::isfinite(old))
+    erase(old);
+  if (std::isfinite(value))
+    insert(value);
+}
+
+size_t Statistics::size() const {
+  return count;
+}
+
+double Statistics::min() const {
+  return min_value;
+}
+
+double Statistics::max() const {
+  return max_value;
+}
+
+double Statistics::nth(size_t k) const {
+  if (count == 0)
+    return 0.0;
+  k = std::min(k, count - 1);
+
+  // Find the block, then the bin containing the k-th element
+  size_t block = 0, i;
+  for (; k >= blocks[block]; ++block)
+    k -= blocks[block];
+  for (i = block * BINS_PER_BLOCK; k >= bins[i]; ++i)
+    k -= bins[i];
+
+  double width = (range_max - range_min) / BINS;
+  double t = (k + 0.5) / bins[i];
+  return std::min(std::max(range_min + width * (i + t), min_value), max_value);
+}
+
+double Statistics::quantile(double ratio) const {
+  size_t n = size();
+  return n ? nth(static_cast<size_t>(ratio * (n - 1) + 0.5)) : 0.0;
+}
+
+std::vector<size_t> Statistics::histogram(size_t n) const {
+  std::vector<size_t> result(n, 0);
+  double width = (range_max - range_min) / BINS, span = max_value - min_value;
+  for (size_t i = 0; i < BINS; ++i) {
+    if (bins[i] == 0)
+      continue;
+    double t = span > 0.0 ? (range_min + width * (i + 0.5) - min_value) / span : 0.0;
+    size_t j = std::min(static_cast<size_t>(std::max(t, 0.0) * n), n - 1);
+    result[j] += bins[i];
+  }
+  return result;
+}
+
+void Statistics::insert(double value) {
+  if (count == 0) {
+    // Nothing to keep, restart the bins at this value
+    std::fill(bins.begin(), bins.end(), 0);
+    std::fill(blocks.begin(), blocks.end(), 0);
+    range_min = range_max = min_value = max_value = value;
+    min_count = max_count = 0;
+  } else if (value < range_min || value > range_max)
+    grow(value);
+
+  auto i = bin(value);
+  bins[i]++;
+  blocks[i / BINS_PER_BLOCK]++;
+  count++;
+  if (value < min_value) {
+    min_value = value;
+    min_count = 0;
+  }
+  if (value > max_value) {
+    max_value = value;
+    max_count = 0;
+  }
+  min_count += value == min_value;
+  max_count += value == max_value;
+}
+
+void Statistics::erase(double value) {
+  auto i = bin(value);
+  bins[i]--;
+  blocks[i / BINS_PER_BLOCK]--;
+  count--;
+  if (count == 0) {
+    min_value = max_value = 0.0;
+    min_count = max_count = 0;
+    return;
+  }
+
+  // When the last value at an extreme is gone, the extreme moves to the edge of the nearest
+  // nonempty bin (its count is unknown, so it stays 0 until a value reaches it); this is also
+  // redone when the bin at such an inexact extreme becomes empty
+  bool low = value == min_value && min_count > 0 && --min_count == 0;
+  bool high = value == max_value && max_count > 0 && --max_count == 0;
+  double width = (range_max - range_min) / BINS;
+  if (low || (min_count == 0 && bins[bin(min_value)] == 0)) {
+    size_t block = 0, j;
+    while (blocks[block] == 0)
+      ++block;
+    for (j = block * BINS_PER_BLOCK; bins[j] == 0; ++j)
+      ;
+    min_value = std::max(range_min + width * j, min_value);
+  }
+  if (high || (max_count == 0 && bins[bin(max_value)] == 0)) {
+    size_t block = BLOCKS - 1, j;
+    while (blocks[block] == 0)
+      --block;
+    for (j = (block + 1) * BINS_PER_BLOCK - 1; bins[j] == 0; --j)
+      ;
+    max_value = std::min(range_min + width * (j + 1), max_value);
+  }
+}
+
+// Doubles the span of the bins towards the value until it fits;
+// with doubling, each new bin is exactly two old ones
+void Statistics::grow(double value) {
+  double lo = range_min, hi = range_max;
+  if (hi == lo) {               // all values are equal (in bin 0)
+    lo = std::min(lo, value);
+    hi = std::max(hi, value);
+  } else {
+    while (value < lo)
+      lo -= hi - lo;
+    while (value > hi)
+      hi += hi - lo;
+  }
+  rebin(lo, hi);
+}
+
+void Statistics::rebin(double lo, double hi) {
+  std::vector<uint32_t> old(BINS, 0);
+  std::swap(old, bins);
+  double old_min = range_min, width = (range_max - range_min) / BINS;
+  range_min = lo;
+  range_max = hi;
+  std::fill(blocks.begin(), blocks.end(), 0);
+  for (size_t i = 0; i < BINS; ++i)
+    if (old[i] > 0) {
+      auto j = bin(old_min + width * (i + 0.5));
+      bins[j] += old[i];
+      blocks[j / BINS_PER_BLOCK] += old[i];
+    }
+}
+
+size_t Statistics::bin(double value) const {
+  if (range_max == range_min)
+    return 0;
+  double t = (value - range_min) / (range_max - range_min);
+  return std::min(static_cast<size_t>(std::max(t, 0.0) * BINS), BINS - 1);
+}
@@ -0,0 +1,51 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Order statistics of a scalar field (e.g. mean curvature) based on a histogram,
+// so that quantiles can be queried without sorting, and updated after local changes.
+// The histogram has 2^16 bins, and values are linearly interpolated inside a bin;
+// non-finite values (e.g. at degenerate vertices) are ignored.
+// After a build, the bins span the [min, max] range of the finite values. A value updated
+// outside of them doubles the span (towards the value) until it fits, merging pairs of bins,
+// so the range grows in amortized constant time, at the cost of resolution until the next
+// build. When the last value at the minimum or maximum is removed, the new one is taken from
+// the histogram, so it is exact to a bin width.
+class Statistics {
+public:
+  static constexpr size_t BLOCKS = 256, BINS_PER_BLOCK = 256, BINS = BLOCKS * BINS_PER_BLOCK;
+
+  Statistics();
+
+  // Linear time, the histogram is computed in parallel.
+  void build(const std::vector<double> &values);
+
+  // Constant time, unless the range grows or an extreme is removed (then linear in BINS).
+  void update(size_t index, double value);
+
+  size_t size() const;          // number of finite values
+  double min() const;           // of the finite values
+  double max() const;
+  double nth(size_t k) const;   // approximate value of the k-th smallest element
+  double quantile(double ratio) const;
+
+  // Histogram of the [min, max] range with the given number of bins.
+  std::vector<size_t> histogram(size_t bins) const;
+
+private:
+  void insert(double value);
+  void erase(double value);
+  void grow(double value);
+  void rebin(double lo, double hi);
+  size_t bin(double value) const;
+
+  std::vector<double> values;
+  size_t count;
+  double min_value, max_value;
+  size_t min_count, max_count;  // number of values equal to min_value / max_value
+  double range_min, range_max;  // of the bins
+  std::vector<uint32_t> bins, blocks;
+};
@@ -0,0 +1,273 @@
+#include "tessellation-cache.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "mapped-file.hh"
+
+namespace {
+
+  const char MAGIC[8] = { 'B', 'Z', 'R', 'T', 'E', 'S', 'S', 'L' };
+  constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+  constexpr uint32_t VERSION = 1;
+  constexpr uint32_t TRIGONOMETRIC = 1, SINGLE_PRECISION = 2;
+  const char *INDEX_HEADER = "tessellation-cache 1";
+
+  // Followed by the control points, then for each vertex (in the order of gridMesh) the
+  // points, the normals, each field and the two principal directions, all as doubles
+  struct Header {
+    char magic[8];
+    uint32_t byte_order, version;
+    uint64_t key;
+    uint32_t degree[2];
+    uint32_t flags, resolution;
+  };
+  static_assert(sizeof(Header) % sizeof(double) == 0, "the data after the header is aligned");
+
+  Header header(uint64_t key, const Patch &patch, size_t resolution, Precision precision) {
+    Header h;
+    std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.byte_order = BYTE_ORDER_MARK;
+    h.version = VERSION;
+    h.key = key;
+    h.degree[0] = patch.degree[0];
+    h.degree[1] = patch.degree[1];
+    h.flags = (patch.trigonometric ? TRIGONOMETRIC : 0) |
+      (precision == Precision::SINGLE ? SINGLE_PRECISION : 0);
+    h.resolution = resolution;
+    return h;
+  }
+
+  size_t entrySize(const Patch &patch, size_t resolution) {
+    size_t n = resolution * resolution;
+    size_t doubles = 3 * patch.control_points.size() +
+      n * (3 + 3 + CurvatureFields::N_FIELDS + 3 * 2);
+    return sizeof(Header) + doubles * sizeof(double);
+  }
+
+  bool exists(const std::string &filename) {
+    std::ifstream f(filename.c_str());
+    return f.good();
+  }
+
+}
+
+TessellationCache::TessellationCache()
+  : capacity(0), total(0), hit_count(0), miss_count(0), clock(0), temporary_count(0) {
+}
+
+bool TessellationCache::open(const std::string &directory, size_t capacity) {
+  std::lock_guard<std::mutex> lock(mutex);
+  this->directory = directory;
+  this->capacity = capacity;
+  entries.clear();
+  total = clock = 0;
+
+  // A missing or unreadable index starts an empty cache (old entries are found on lookup)
+  std::ifstream f((directory + "/index").c_str());
+  std::string line;
+  if (f.is_open() && std::getline(f, line) && line == INDEX_HEADER) {
+    uint64_t key;
+    Entry entry;
+    while (f >> std::hex >> key >> std::dec >> entry.size >> entry.last_use)
+      if (exists(filename(key))) {
+        entries[key] = entry;
+        total += entry.size;
+        clock = std::max(clock, entry.last_use);
+      }
+  }
+  evict();
+  try {
+    saveIndex();
+  } catch(std::ios::failure &) {
+    this->directory.clear();    // not writable
+    return false;
+  }
+  return true;
+}
+
+bool TessellationCache::isOpen() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return !directory.empty();
+}
+
+// FNV-1a of everything the tessellation depends on
+uint64_t TessellationCache::key(const Patch &patch, size_t resolution, Precision precision) {
+  uint64_t hash = 14695981039346656037ull;
+  auto add = [&](const void *data, size_t size) {
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i) {
+      hash ^= p[i];
+      hash *= 1099511628211ull;
+    }
+  };
+  const uint64_t params[] = {
+    patch.degree[0], patch.degree[1], patch.trigonometric, resolution,
+    precision == Precision::SINGLE
+  };
+  add(params, sizeof(params));
+  add(patch.control_points.data(), patch.control_points.size() * sizeof(Vector));
+  return hash;
+}
+
+bool TessellationCache::load(const Patch &patch, size_t resolution, Precision precision,
+                             MyMesh &mesh, CurvatureFields &fields) {
+  if (!isOpen())
+    return false;
+  uint64_t k = key(patch, resolution, precision);
+  auto expected = header(k, patch, resolution, precision);
+  size_t cp = patch.control_points.size(), n = resolution * resolution;
+  MappedFile file;
+  if (!file.open(filename(k)) || file.size() != entrySize(patch, resolution) ||
+      std::memcmp(file.data(), &expected, sizeof(Header)) != 0 ||
+      std::memcmp(file.data() + sizeof(Header), patch.control_points.data(),
+                  cp * sizeof(Vector)) != 0) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++miss_count;
+    return false;
+  }
+
+  const double *data = reinterpret_cast<const double *>(file.data() + sizeof(Header)) + 3 * cp;
+  auto vectors = [&](std::vector<Vector> &v) {
+    v.resize(n);
+    for (size_t i = 0; i < n; ++i, data += 3)
+      v[i] = Vector(data[0], data[1], data[2]);
+  };
+  std::vector<Vector> points, normals;
+  vectors(points);
+  vectors(normals);
+  gridMesh(resolution, points, mesh);
+  mesh.request_vertex_normals();
+  for (auto v : mesh.vertices())
+    mesh.set_normal(v, normals[v.idx()]);
+  fields.reset(n);
+  for (auto &values : fields.values) {
+    values.assign(data, data + n);
+    data += n;
+  }
+  for (auto &directions : fields.directions)
+    vectors(directions);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  ++hit_count;
+  use(k, file.size());
+  evict();
+  try {
+    saveIndex();
+  } catch(std::ios::failure &) {
+  }
+  return true;
+}
+
+void TessellationCache::store(const Patch &patch, size_t resolution, Precision precision,
+                              const MyMesh &mesh, const CurvatureFields &fields) {
+  size_t n = resolution * resolution, size = entrySize(patch, resolution);
+  bool complete = mesh.n_vertices() == n && mesh.has_vertex_normals();
+  for (const auto &values : fields.values)
+    complete = complete && values.size() == n;
+  for (const auto &directions : fields.directions)
+    complete = complete && directions.size() == n;
+  std::string temporary;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (directory.empty() || !complete || size > capacity)
+      return;
+    temporary = directory + "/" + std::to_string(temporary_count++) + ".tmp";
+  }
+
+  uint64_t k = key(patch, resolution, precision);
+  try {
+    std::ofstream f(temporary.c_str(), std::ios::binary);
+    f.exceptions(std::ios::failbit | std::ios::badbit);
+    auto h = header(k, patch, resolution, precision);
+    f.write(reinterpret_cast<const char *>(&h), sizeof(Header));
+    auto write = [&](const Vector &p) {
+      f.write(reinterpret_cast<const char *>(p.data()), 3 * sizeof(double));
+    };
+    for (const auto &p : patch.control_points)
+      write(p);
+    for (auto v : mesh.vertices())
+      write(mesh.point(v));
+    for (auto v : mesh.vertices())
+      write(mesh.normal(v));
+    for (const auto &values : fields.values)
+      f.write(reinterpret_cast<const char *>(values.data()), n * sizeof(double));
+    for (const auto &directions : fields.directions)
+      for (const auto &d : directions)
+        write(d);
+    f.close();
+  } catch(std::ios::failure &) {
+    std::remove(temporary.c_str());
+    return;
+  }
+  auto name = filename(k);
+  std::remove(name.c_str());    // rename does not replace files everywhere
+  if (std::rename(temporary.c_str(), name.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  use(k, size);
+  evict();
+  try {
+    saveIndex();
+  } catch(std::ios::failure &) {
+  }
+}
+
+size_t TessellationCache::hits() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return hit_count;
+}
+
+size_t TessellationCache::misses() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return miss_count;
+}
+
+std::string TessellationCache::filename(uint64_t key) const {
+  std::ostringstream s;
+  s << directory << '/' << std::hex << std::setw(16) << std::setfill('0') << key << ".tsc";
+  return s.str();
+}
+
+void TessellationCache::use(uint64_t key, size_t size) {
+  auto it = entries.find(key);
+  if (it != entries.end())
+    total -= it->second.size;
+  entries[key] = { size, ++clock };
+  total += size;
+}
+
+// Linear in the number of entries, which is small (the entries are large)
+void TessellationCache::evict() {
+  while (total > capacity && !entries.empty()) {
+    auto oldest = entries.begin();
+    for (auto it = entries.begin(); it != entries.end(); ++it)
+      if (it->second.last_use < oldest->second.last_use)
+        oldest = it;
+    std::remove(filename(oldest->first).c_str());
+    total -= oldest->second.size;
+    entries.erase(oldest);
+  }
+}
+
+// Throws std::ios::failure
+void TessellationCache::saveIndex() const {
+  std::string name = directory + "/index", temporary = name + ".tmp";
+  {
+    std::ofstream f(temporary.c_str());
+    f.exceptions(std::ios::failbit | std::ios::badbit);
+    f << INDEX_HEADER << std::endl;
+    for (const auto &e : entries)
+      f << std::hex << e.first << std::dec << ' ' << e.second.size << ' '
+        << e.second.last_use << std::endl;
+  }
+  std::remove(name.c_str());
+  std::rename(temporary.c_str(), name.c_str());
+}
@@ -0,0 +1,63 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "curvature.hh"
+#include "tessellation.hh"
+
+// Persistent cache of tessellated patches with their normals and curvature fields
+// (the results of tessellate, patchNormals and patchCurvatures), so that reloading or
+// reprocessing an unchanged control net needs no evaluation.
+//
+// Entries are content-addressed: each is a file in the cache directory, named by a hash of
+// the degrees, basis, control points, resolution and precision. These are also stored in the
+// file and compared on lookup, so a hash collision is only a miss. An entry is a header and
+// raw doubles in the byte order of the host, read through MappedFile; files of other hosts
+// or versions are misses. When the total size exceeds the capacity, the least recently used
+// entries are removed; the order of use is kept in an index file.
+//
+// Thread-safe, but a directory should be used by one process at a time. Entries are written
+// under a temporary name and renamed, so an interrupted store never leaves a partial entry.
+class TessellationCache {
+public:
+  TessellationCache();
+
+  // The directory should exist. Until opened, every lookup is a miss and stores are ignored.
+  bool open(const std::string &directory, size_t capacity = 256 << 20);
+  bool isOpen() const;
+
+  static uint64_t key(const Patch &patch, size_t resolution, Precision precision);
+
+  // On a hit, sets the mesh (as tessellate, with vertex normals) and the fields,
+  // and returns true.
+  bool load(const Patch &patch, size_t resolution, Precision precision,
+            MyMesh &mesh, CurvatureFields &fields);
+  // The mesh should have the vertex normals and the fields of the patch.
+  void store(const Patch &patch, size_t resolution, Precision precision,
+             const MyMesh &mesh, const CurvatureFields &fields);
+
+  size_t hits() const;
+  size_t misses() const;
+
+private:
+  struct Entry {
+    size_t size;
+    uint64_t last_use;
+  };
+
+  std::string filename(uint64_t key) const;
+  void use(uint64_t key, size_t size); // with the mutex locked
+  void evict();                        // with the mutex locked
+  void saveIndex() const;              // with the mutex locked
+
+  std::string directory;
+  size_t capacity, total, hit_count, miss_count;
+  uint64_t clock, temporary_count;
+  std::map<uint64_t, Entry> entries;
+  mutable std::mutex mutex;
+};
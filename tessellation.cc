@@ -0,0 +1,60 @@
+#include "tessellation.hh"
+
+void tessellate(const Patch &patch, size_t resolution, MyMesh &mesh, Precision precision) {
+  std::vector<Vector> points;
+  if (precision == Precision::SINGLE)
+    patch.evaluateGrid<float>(resolution, points);
+  else
+    patch.evaluateGrid<double>(resolution, points);
+  gridMesh(resolution, points, mesh);
+}
+
+void gridMesh(size_t resolution, const std::vector<Vector> &points, MyMesh &mesh) {
+  int n = resolution * resolution;
+  mesh.clear();
+  size_t cells = (resolution - 1) * (resolution - 1);
+  mesh.reserve(n, 3 * cells + 2 * (resolution - 1), 2 * cells);
+  std::vector<MyMesh::VertexHandle> handles, tri;
+  handles.reserve(n);
+  for (size_t i = 0, k = 0; i < resolution; ++i) {
+    double u = (double)i / (double)(resolution - 1);
+    for (size_t j = 0; j < resolution; ++j, ++k) {
+      double v = (double)j / (double)(resolution - 1);
+      handles.push_back(mesh.add_vertex(points[k]));
+      mesh.data(handles.back()).u = u;
+      mesh.data(handles.back()).v = v;
+    }
+  }
+  for (size_t i = 0; i < resolution - 1; ++i)
+    for (size_t j = 0; j < resolution - 1; ++j) {
+      tri.clear();
+      tri.push_back(handles[i * resolution + j]);
+      tri.push_back(handles[i * resolution + j + 1]);
+      tri.push_back(handles[(i + 1) * resolution + j]);
+      mesh.add_face(tri);
+      tri.clear();
+      tri.push_back(handles[(i + 1) * resolution + j]);
+      tri.push_back(handles[i * resolution + j + 1]);
+      tri.push_back(handles[(i + 1) * resolution + j + 1]);
+      mesh.add_face(tri);
+    }
+}
+
+void patchNormals(const Patch &patch, MyMesh &mesh) {
+  int nv = mesh.n_vertices();
+#pragma omp parallel for
+  for (int i = 0; i < nv; ++i) {
+    MyMesh::VertexHandle v(i);
+    auto &der = EvaluationWorkspace::local().der;
+    patch.evaluate(mesh.data(v).u, mesh.data(v).v, 1, der);
+    mesh.set_normal(v, patchNormal(der[1][0], der[0][1]));
+  }
+}
+
+Vector patchNormal(const Vector &su, const Vector &sv) {
+  Vector n = sv % su;
+  double len = n.length();
+  if (len != 0.0)
+    n /= len;
+  return n;
+}
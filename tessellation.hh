@@ -0,0 +1,20 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include "patch.hh"
+
+// Single precision is enough for display, see Patch::evaluateGrid.
+enum class Precision { SINGLE, DOUBLE };
+
+// Regular triangulation of the patch with resolution x resolution vertices,
+// storing the (u, v) parameters in the vertex data. The points are evaluated in parallel.
+void tessellate(const Patch &patch, size_t resolution, MyMesh &mesh,
+                Precision precision = Precision::DOUBLE);
+
+// The triangulation of tessellate() on the given resolution x resolution points (u major).
+void gridMesh(size_t resolution, const std::vector<Vector> &points, MyMesh &mesh);
+
+// Exact normals of a tessellated patch, in parallel.
+void patchNormals(const Patch &patch, MyMesh &mesh);
+// The normal of patchNormals from the first derivatives (sv x su normalized, or zero).
+Vector patchNormal(const Vector &su, const Vector &sv);
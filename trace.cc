@@ -0,0 +1,105 @@
+#include "trace.hh"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+  struct Event {
+    const char *name;
+    char phase;                 // 'X': complete event, 'C': counter
+    double time, value;         // value is the duration of 'X' events
+  };
+
+  struct Buffer {
+    size_t thread;
+    std::vector<Event> events;
+  };
+
+  std::atomic<bool> recording(false);
+  const auto origin = std::chrono::steady_clock::now();
+
+  std::mutex buffers_mutex;
+  std::vector<std::unique_ptr<Buffer>> buffers; // kept after their threads exit
+
+  double now() {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin)
+      .count();
+  }
+
+  Buffer &localBuffer() {
+    thread_local Buffer *buffer = nullptr;
+    if (!buffer) {
+      std::lock_guard<std::mutex> lock(buffers_mutex);
+      buffers.emplace_back(new Buffer);
+      buffer = buffers.back().get();
+      buffer->thread = buffers.size() - 1;
+    }
+    return *buffer;
+  }
+
+}
+
+namespace Trace {
+
+  void enable(bool on) {
+    recording.store(on, std::memory_order_relaxed);
+  }
+
+  bool enabled() {
+    return recording.load(std::memory_order_relaxed);
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    for (auto &b : buffers)
+      b->events.clear();
+  }
+
+  void counter(const char *name, double value) {
+    if (enabled())
+      localBuffer().events.push_back({ name, 'C', now(), value });
+  }
+
+  bool save(const std::string &filename) {
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    try {
+      std::ofstream f(filename.c_str());
+      f.exceptions(std::ios::failbit | std::ios::badbit);
+      f.precision(15);
+      f << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+      bool first = true;
+      for (const auto &b : buffers)
+        for (const auto &e : b->events) {
+          if (!first)
+            f << ',' << std::endl;
+          first = false;
+          f << "{\"name\":\"" << e.name << "\",\"ph\":\"" << e.phase
+            << "\",\"pid\":1,\"tid\":" << b->thread << ",\"ts\":" << e.time;
+          if (e.phase == 'X')
+            f << ",\"dur\":" << e.value << '}';
+          else
+            f << ",\"args\":{\"value\":" << e.value << "}}";
+        }
+      f << std::endl << "]}" << std::endl;
+    } catch(std::ofstream::failure &) {
+      return false;
+    }
+    return true;
+  }
+
+  Scope::Scope(const char *name) : name(name), start(enabled() ? now() : -1.0) {
+  }
+
+  Scope::~Scope() {
+    if (start >= 0.0) {
+      double end = now();
+      localBuffer().events.push_back({ name, 'X', start, end - start });
+    }
+  }
+
+}
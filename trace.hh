@@ -0,0 +1,35 @@
+// -*- mode: c++ -*-
+#pragma once
+
+#include <string>
+
+// Timing of pipeline stages and counters, saved in the Chrome trace event format
+// (see chrome://tracing or ui.perfetto.dev). Recording is off by default; then a scope
+// costs a relaxed atomic load. Events go to per-thread buffers, so parallel loops can be
+// traced without locking, but clear() and save() should not run concurrently with them.
+namespace Trace {
+
+  void enable(bool on);
+  bool enabled();
+  void clear();
+
+  // Records the current value of a counter (e.g. the number of vertices)
+  void counter(const char *name, double value);
+
+  bool save(const std::string &filename);
+
+  // Records the time spent in the enclosing scope; the name should be a string literal
+  class Scope {
+  public:
+    explicit Scope(const char *name);
+    ~Scope();
+  private:
+    const char *name;
+    double start;               // in microseconds, negative when not recording
+  };
+
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
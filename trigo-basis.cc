@@ -55,14 +55,19 @@ void trigoinit(std::string filename) {
   }
 }
 
+bool trigosupports(size_t n) {
+  return n >= 2 && n <= table_rows + 1;
+}
+
 void trigobasis(size_t n, double u, size_t derivatives, std::vector<DoubleVector> &coeffs) {
   if (derivatives > DERIVATIVES)
     throw std::runtime_error(std::string("The table only has ") + std::to_string(DERIVATIVES) +
                              " derivatives");
-  if (n < 2 || n > table_rows + 1)
+  if (!trigosupports(n))
     throw std::runtime_error(std::string("The table only has rows for 3 to ") +
                              std::to_string(table_rows + 2) + " control points");
-  coeffs.resize(derivatives + 1);
+  if (coeffs.size() < derivatives + 1)
+    coeffs.resize(derivatives + 1); // never shrink, to keep the buffers of the rows
   for (size_t d = 0; d <= derivatives; ++d) {
     const auto &row = triangles[d][n-2];
     coeffs[d].clear();
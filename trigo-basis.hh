@@ -5,5 +5,8 @@
 
 void trigoinit(std::string filename);
 
+// Whether the table has a row for degree n (none before trigoinit)
+bool trigosupports(size_t n);
+
 void trigobasis(size_t n, double u, size_t derivatives,
                 std::vector<std::vector<double>> &coeffs);